@@ -0,0 +1,191 @@
+#include <stdlib.h>
+
+#include "arena.h"
+
+struct ArenaSlab {
+    ArenaSlab *next;
+    /* keep the blocks that follow the header aligned to the granularity */
+    _Alignas(ARENA_GRANULARITY) unsigned char data[];
+};
+
+struct ArenaLarge {
+    ArenaLarge *prev,
+               *next;
+    _Alignas(ARENA_GRANULARITY) unsigned char data[];
+};
+
+struct ArenaFreeBlock {
+    ArenaFreeBlock *next;
+};
+
+static inline size_t
+size_class(const size_t size) {
+    /* zero-sized requests still need a distinct block */
+    return size > 0 ? (size - 1) / ARENA_GRANULARITY : 0;
+}
+
+void
+arena_init(Arena *arena) {
+    *arena = (Arena) {
+        .slabs = NULL
+    };
+}
+
+/*
+Allocate a block of "size" bytes from the arena.
+RETURN VALUE:
+    On success, a pointer to the block, aligned to ARENA_GRANULARITY.
+    On failure, NULL.
+*/
+void *
+arena_alloc(Arena *arena, const size_t size) {
+    if (size > ARENA_MAX_CLASS_SIZE) {
+        ArenaLarge *large = malloc(sizeof(ArenaLarge) + size);
+        if (!large) {
+            return NULL;
+        }
+
+        large->prev = NULL;
+        large->next = arena->large;
+
+        if (arena->large) {
+            arena->large->prev = large;
+        }
+
+        arena->large = large;
+        arena->bytes_in_use += size;
+        arena->bytes_reserved += sizeof(ArenaLarge) + size;
+
+        return large->data;
+    }
+
+    const size_t class = size_class(size),
+                 block_size = (class + 1) * ARENA_GRANULARITY;
+
+    /* recycle a previously freed block of the same class */
+    ArenaFreeBlock *block = arena->free_lists[class];
+    if (block) {
+        arena->free_lists[class] = block->next;
+        arena->bytes_in_use += block_size;
+        return block;
+    }
+
+    if ((size_t) (arena->end - arena->cursor) < block_size) {
+        ArenaSlab *slab = malloc(sizeof(ArenaSlab) + ARENA_SLAB_SIZE);
+        if (!slab) {
+            return NULL;
+        }
+
+        /* whatever was left of the previous slab is abandoned until the arena is released */
+        slab->next = arena->slabs;
+        arena->slabs = slab;
+        arena->cursor = slab->data;
+        arena->end = slab->data + ARENA_SLAB_SIZE;
+        arena->bytes_reserved += sizeof(ArenaSlab) + ARENA_SLAB_SIZE;
+    }
+
+    void *ptr = arena->cursor;
+    arena->cursor += block_size;
+    arena->bytes_in_use += block_size;
+
+    return ptr;
+}
+
+/*
+Return a block previously allocated from the arena with the same "size".
+*/
+void
+arena_free(Arena *arena, void *ptr, const size_t size) {
+    if (size > ARENA_MAX_CLASS_SIZE) {
+        ArenaLarge *large = (ArenaLarge *) ((unsigned char *) ptr - offsetof(ArenaLarge, data));
+
+        if (large->prev) {
+            large->prev->next = large->next;
+        } else {
+            arena->large = large->next;
+        }
+
+        if (large->next) {
+            large->next->prev = large->prev;
+        }
+
+        free(large);
+        arena->bytes_in_use -= size;
+        arena->bytes_reserved -= sizeof(ArenaLarge) + size;
+
+        return;
+    }
+
+    const size_t class = size_class(size);
+    ArenaFreeBlock *block = ptr;
+
+    block->next = arena->free_lists[class];
+    arena->free_lists[class] = block;
+    arena->bytes_in_use -= (class + 1) * ARENA_GRANULARITY;
+}
+
+/*
+Move every allocation of "other" into "arena", to be freed along with the allocations of "arena",
+and leave "other" empty. Whatever is left of the current slab of "other" is abandoned.
+*/
+void
+arena_merge(Arena *arena, Arena *other) {
+    while (other->slabs) {
+        ArenaSlab *next = other->slabs->next;
+        other->slabs->next = arena->slabs;
+        arena->slabs = other->slabs;
+        other->slabs = next;
+    }
+
+    while (other->large) {
+        ArenaLarge *next = other->large->next;
+        other->large->next = arena->large;
+        other->large->prev = NULL;
+
+        if (arena->large) {
+            arena->large->prev = other->large;
+        }
+
+        arena->large = other->large;
+        other->large = next;
+    }
+
+    for (size_t class = 0; class < ARENA_CLASS_COUNT; class++) {
+        while (other->free_lists[class]) {
+            ArenaFreeBlock *next = other->free_lists[class]->next;
+            other->free_lists[class]->next = arena->free_lists[class];
+            arena->free_lists[class] = other->free_lists[class];
+            other->free_lists[class] = next;
+        }
+    }
+
+    arena->bytes_in_use += other->bytes_in_use;
+    arena->bytes_reserved += other->bytes_reserved;
+
+    arena_init(other);
+}
+
+/*
+Free all memory owned by the arena, invalidating every block allocated from it, and leave the
+arena empty and ready for reuse.
+*/
+void
+arena_release(Arena *arena) {
+    ArenaSlab *slab = arena->slabs;
+
+    while (slab) {
+        ArenaSlab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+
+    ArenaLarge *large = arena->large;
+
+    while (large) {
+        ArenaLarge *next = large->next;
+        free(large);
+        large = next;
+    }
+
+    arena_init(arena);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Size-classed slab arena used for the nodes and key copies of a hash map.
+
+Small allocations are bump-allocated from large slabs, so consecutively inserted nodes end up
+next to each other in memory. Freed small blocks go onto a free list for their size class and are
+recycled by the next allocation of the same class. Blocks larger than the largest size class get
+an allocation of their own, but are still tracked by the arena. Releasing the arena frees every
+slab and large block without having to walk the individual allocations.
+
+An arena is not thread safe.
+*/
+
+#define ARENA_GRANULARITY 16
+#define ARENA_CLASS_COUNT 16
+#define ARENA_MAX_CLASS_SIZE (ARENA_GRANULARITY * ARENA_CLASS_COUNT)
+#define ARENA_SLAB_SIZE (64 * 1024)
+
+typedef struct ArenaSlab ArenaSlab;
+typedef struct ArenaLarge ArenaLarge;
+typedef struct ArenaFreeBlock ArenaFreeBlock;
+
+typedef struct Arena {
+    ArenaSlab *slabs;
+    ArenaLarge *large;
+
+    unsigned char *cursor,
+                  *end;
+
+    ArenaFreeBlock *free_lists[ARENA_CLASS_COUNT];
+
+    /* bytes currently handed out to callers, rounded up to the size class */
+    size_t bytes_in_use;
+
+    /* bytes obtained from malloc for slabs and large blocks, headers included */
+    size_t bytes_reserved;
+} Arena;
+
+void
+arena_init(Arena *arena);
+
+void *
+arena_alloc(Arena *arena, const size_t size);
+
+void
+arena_free(Arena *arena, void *ptr, const size_t size);
+
+void
+arena_merge(Arena *arena, Arena *other);
+
+void
+arena_release(Arena *arena);
@@ -11,14 +11,9 @@ start_benchmark(void) {
 }
 
 /*
-Return time elapsed since benchmark was started, in milliseconds.
+Return time elapsed since benchmark was started, in nanoseconds.
 */
 static inline uint64_t
 end_benchmark(const uint64_t nanos_at_start) {
-    struct timespec benchmark_time_end;
-    clock_gettime(CLOCK_MONOTONIC_RAW, &benchmark_time_end);
-
-    uint64_t nanos_at_end = (benchmark_time_end.tv_nsec) + (benchmark_time_end.tv_sec * 1000000000);
-
-    return (nanos_at_end - nanos_at_start) / 1000000;
+    return start_benchmark() - nanos_at_start;
 }
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include "bhashmap.h"
+
+#define TIMER_GET(s) clock_gettime(CLOCK_MONOTONIC_RAW, s);
+#define TIMER_DIFF(s, e) ((e.tv_sec * 1000000000 + e.tv_nsec) - (s.tv_sec * 1000000000 + s.tv_nsec))
+
+/* every key length is hashed over about this many bytes in total */
+#define BYTES_PER_LENGTH (256 * 1024 * 1024)
+#define MIN_HASHES_PER_LENGTH (4 * 1024 * 1024)
+
+#define BUFFER_SIZE (64 * 1024)
+
+static const size_t KEY_LENGTHS[] = { 4, 8, 12, 16, 24, 32, 48, 64, 128, 256, 512, 1024, 4096, 16384 };
+
+struct hash_candidate {
+    const char *name;
+    bhm_hash_function64 function;
+};
+
+static const struct hash_candidate CANDIDATES[] = {
+    { "wyhash", bhm_hash_wyhash },
+    { "murmur3", bhm_hash_murmur3 }
+};
+
+/*
+Hash keys of a single length back to back, from a rolling offset into the buffer so that short
+keys don't all start at the same address, and return the average time per hash in nanoseconds.
+*/
+static double
+time_hash(const struct hash_candidate *candidate, const unsigned char *buffer, const size_t keylen, uint64_t *sink) {
+    size_t hash_count = BYTES_PER_LENGTH / keylen;
+    if (hash_count < MIN_HASHES_PER_LENGTH / (keylen / 64 + 1)) {
+        hash_count = MIN_HASHES_PER_LENGTH / (keylen / 64 + 1);
+    }
+
+    const size_t offset_range = BUFFER_SIZE - keylen;
+
+    struct timespec time_start, time_end;
+    uint64_t acc = 0;
+
+    TIMER_GET(&time_start);
+
+    for (size_t i = 0; i < hash_count; i++) {
+        /* feeding the previous hash into the seed keeps the calls from being overlapped or elided */
+        acc = candidate->function(buffer + (i * 61) % offset_range, keylen, acc);
+    }
+
+    TIMER_GET(&time_end);
+
+    *sink ^= acc;
+
+    return (double) TIMER_DIFF(time_start, time_end) / (double) hash_count;
+}
+
+/* usage: ./prog */
+int main(void) {
+    unsigned char *buffer = malloc(BUFFER_SIZE);
+    if (!buffer) {
+        return EXIT_FAILURE;
+    }
+
+    srand(1);
+    for (size_t i = 0; i < BUFFER_SIZE; i++) {
+        buffer[i] = rand();
+    }
+
+    fprintf(
+        stderr,
+        "Benchmark: Hash throughput over short and long keys\n"
+        "------------------\n"
+        "%-10s %-10s %-14s %-14s\n",
+        "HASH", "KEY LEN", "NS/HASH", "GB/S"
+    );
+
+    uint64_t sink = 0;
+
+    for (size_t c = 0; c < sizeof(CANDIDATES) / sizeof(CANDIDATES[0]); c++) {
+        for (size_t l = 0; l < sizeof(KEY_LENGTHS) / sizeof(KEY_LENGTHS[0]); l++) {
+            const double ns = time_hash(&CANDIDATES[c], buffer, KEY_LENGTHS[l], &sink);
+
+            fprintf(stderr, "%-10s %-10lu %-14.2lf %-14.2lf\n", CANDIDATES[c].name, KEY_LENGTHS[l], ns, KEY_LENGTHS[l] / ns);
+        }
+    }
+
+    /* print the combined hashes so that the compiler can't discard any of the work */
+    fprintf(stderr, "------------------\nchecksum: %016lx\n", sink);
+
+    free(buffer);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include "bhashmap.h"
+#include "bhashmap_template.h"
+
+#define TIMER_GET(s) clock_gettime(CLOCK_MONOTONIC_RAW, s);
+#define TIMER_DIFF(s, e) ((e.tv_sec * 1000000000 + e.tv_nsec) - (s.tv_sec * 1000000000 + s.tv_nsec))
+
+#define DEFAULT_KEY_COUNT (1024 * 1024)
+#define DEFAULT_ITER_COUNT 8
+
+BHM_DEFINE_MAP(u64map, uint64_t, uint64_t, bhm_hash_u64, bhm_eq_u64)
+
+struct timing {
+    size_t insert_ns,
+           access_ns;
+};
+
+/* random 64-bit ids, the typical shape of integer keys */
+static uint64_t *
+make_keys(const size_t key_count) {
+    uint64_t *keys = malloc(key_count * sizeof(uint64_t));
+    if (!keys) {
+        return NULL;
+    }
+
+    uint64_t state = 0x2545f4914f6cdd1dull;
+    for (size_t i = 0; i < key_count; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        keys[i] = state;
+    }
+
+    return keys;
+}
+
+static int
+bench_generic(const uint64_t *keys, const size_t key_count, const BHashMapBackend backend, struct timing *timing) {
+    const BHashMapConfig config = {
+        .backend = backend
+    };
+
+    BHashMap *map = bhm_create(0, &config);
+    if (!map) {
+        return EXIT_FAILURE;
+    }
+
+    struct timespec time_start, time_end;
+
+    TIMER_GET(&time_start);
+    for (size_t i = 0; i < key_count; i++) {
+        bhm_set(map, &keys[i], sizeof(keys[i]), (void *) (uintptr_t) i);
+    }
+    TIMER_GET(&time_end);
+    timing->insert_ns += TIMER_DIFF(time_start, time_end);
+
+    uintptr_t sum = 0;
+
+    TIMER_GET(&time_start);
+    for (size_t i = 0; i < key_count; i++) {
+        sum += (uintptr_t) bhm_get(map, &keys[i], sizeof(keys[i]));
+    }
+    TIMER_GET(&time_end);
+    timing->access_ns += TIMER_DIFF(time_start, time_end);
+
+    bhm_destroy(map);
+
+    return sum == key_count * (key_count - 1) / 2 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int
+bench_u64(const uint64_t *keys, const size_t key_count, const BHashMapBackend backend, struct timing *timing) {
+    const BHashMapConfig config = {
+        .backend = backend
+    };
+
+    BHashMap *map = bhm_create(0, &config);
+    if (!map) {
+        return EXIT_FAILURE;
+    }
+
+    struct timespec time_start, time_end;
+
+    TIMER_GET(&time_start);
+    for (size_t i = 0; i < key_count; i++) {
+        bhm_set_u64(map, keys[i], (void *) (uintptr_t) i);
+    }
+    TIMER_GET(&time_end);
+    timing->insert_ns += TIMER_DIFF(time_start, time_end);
+
+    uintptr_t sum = 0;
+
+    TIMER_GET(&time_start);
+    for (size_t i = 0; i < key_count; i++) {
+        sum += (uintptr_t) bhm_get_u64(map, keys[i]);
+    }
+    TIMER_GET(&time_end);
+    timing->access_ns += TIMER_DIFF(time_start, time_end);
+
+    bhm_destroy(map);
+
+    return sum == key_count * (key_count - 1) / 2 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int
+bench_template(const uint64_t *keys, const size_t key_count, struct timing *timing) {
+    u64map map;
+    if (!u64map_init(&map, 0)) {
+        return EXIT_FAILURE;
+    }
+
+    struct timespec time_start, time_end;
+
+    TIMER_GET(&time_start);
+    for (size_t i = 0; i < key_count; i++) {
+        u64map_set(&map, keys[i], i);
+    }
+    TIMER_GET(&time_end);
+    timing->insert_ns += TIMER_DIFF(time_start, time_end);
+
+    uint64_t sum = 0;
+
+    TIMER_GET(&time_start);
+    for (size_t i = 0; i < key_count; i++) {
+        sum += *u64map_get(&map, keys[i]);
+    }
+    TIMER_GET(&time_end);
+    timing->access_ns += TIMER_DIFF(time_start, time_end);
+
+    u64map_destroy(&map);
+
+    return sum == key_count * (key_count - 1) / 2 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void
+print_timing(const char *name, const struct timing *timing, const size_t key_count, const size_t iterations) {
+    fprintf(
+        stderr,
+        "%-36s %-16lu %-16lu\n",
+        name,
+        timing->insert_ns / iterations / key_count,
+        timing->access_ns / iterations / key_count
+    );
+}
+
+/* usage: ./prog [<key_count>] [<iterations>] */
+int main(int argc, char **argv) {
+    const size_t key_count = argc >= 2 ? atoll(argv[1]) : DEFAULT_KEY_COUNT,
+                 iterations = argc >= 3 ? atoll(argv[2]) : DEFAULT_ITER_COUNT;
+
+    uint64_t *keys = make_keys(key_count);
+    if (!keys) {
+        return EXIT_FAILURE;
+    }
+
+    fprintf(
+        stderr,
+        "Benchmark: Insert and access %lu random 64-bit integer keys\n"
+        "ITERATIONS: %lu\n"
+        "------------------\n"
+        "%-36s %-16s %-16s\n",
+        key_count,
+        iterations,
+        "MAP", "NS/INSERT", "NS/ACCESS"
+    );
+
+    struct timing chaining = { 0 },
+                  open = { 0 },
+                  chaining_u64 = { 0 },
+                  open_u64 = { 0 },
+                  template = { 0 };
+
+    for (size_t i = 0; i < iterations; i++) {
+        if (bench_generic(keys, key_count, BHM_BACKEND_CHAINING, &chaining) != EXIT_SUCCESS
+            || bench_generic(keys, key_count, BHM_BACKEND_OPEN_ADDRESSING, &open) != EXIT_SUCCESS
+            || bench_u64(keys, key_count, BHM_BACKEND_CHAINING, &chaining_u64) != EXIT_SUCCESS
+            || bench_u64(keys, key_count, BHM_BACKEND_OPEN_ADDRESSING, &open_u64) != EXIT_SUCCESS
+            || bench_template(keys, key_count, &template) != EXIT_SUCCESS) {
+            free(keys);
+            return EXIT_FAILURE;
+        }
+    }
+
+    print_timing("bhm_set/bhm_get (chaining)", &chaining, key_count, iterations);
+    print_timing("bhm_set/bhm_get (open addressing)", &open, key_count, iterations);
+    print_timing("bhm_set_u64/bhm_get_u64 (chaining)", &chaining_u64, key_count, iterations);
+    print_timing("bhm_set_u64/bhm_get_u64 (open)", &open_u64, key_count, iterations);
+    print_timing("BHM_DEFINE_MAP(uint64_t, uint64_t)", &template, key_count, iterations);
+
+    free(keys);
+    return EXIT_SUCCESS;
+}
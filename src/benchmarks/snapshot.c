@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "bhashmap.h"
+
+#define TIMER_GET(s) clock_gettime(CLOCK_MONOTONIC_RAW, s);
+#define TIMER_DIFF(s, e) ((e.tv_sec * 1000000000 + e.tv_nsec) - (s.tv_sec * 1000000000 + s.tv_nsec))
+
+#define WORDS_COUNT 466550
+#define MAXWORDLEN  50
+
+#define DEFAULT_SNAPSHOT_PATH "words.bhm"
+#define DEFAULT_ITER_COUNT 8
+
+struct wordpair {
+    char word[MAXWORDLEN];
+    size_t len;
+};
+
+struct timing {
+    size_t startup_ns,
+           access_ns;
+};
+
+/*
+Drop the pages of the snapshot from the page cache, so that the next open reads it from disk as
+after a reboot. Only clean pages can be dropped, hence the sync first.
+*/
+static void
+evict_page_cache(const char *path) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+/* look up every word once and check that each maps to its own index */
+static int
+access_words(const BHashMap *map, const struct wordpair *words, const size_t word_count, size_t *access_ns) {
+    struct timespec time_start, time_end;
+    size_t mismatches = 0;
+
+    TIMER_GET(&time_start);
+    for (size_t i = 0; i < word_count; i++) {
+        mismatches += (uintptr_t) bhm_get(map, words[i].word, words[i].len) != i + 1;
+    }
+    TIMER_GET(&time_end);
+
+    *access_ns += TIMER_DIFF(time_start, time_end);
+
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int
+bench_rebuild(const struct wordpair *words, const size_t word_count, struct timing *timing) {
+    struct timespec time_start, time_end;
+
+    TIMER_GET(&time_start);
+
+    BHashMap *map = bhm_create(0, NULL);
+    if (!map) {
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < word_count; i++) {
+        bhm_set(map, words[i].word, words[i].len, (void *) (uintptr_t) (i + 1));
+    }
+
+    TIMER_GET(&time_end);
+    timing->startup_ns += TIMER_DIFF(time_start, time_end);
+
+    const int status = access_words(map, words, word_count, &timing->access_ns);
+
+    bhm_destroy(map);
+
+    return status;
+}
+
+static int
+bench_open(const char *snapshot_path, const bool cold, const struct wordpair *words, const size_t word_count, struct timing *timing) {
+    if (cold) {
+        evict_page_cache(snapshot_path);
+    }
+
+    struct timespec time_start, time_end;
+
+    TIMER_GET(&time_start);
+
+    BHashMap *map = bhm_open_mmap(snapshot_path);
+    if (!map) {
+        return EXIT_FAILURE;
+    }
+
+    TIMER_GET(&time_end);
+    timing->startup_ns += TIMER_DIFF(time_start, time_end);
+
+    const int status = access_words(map, words, word_count, &timing->access_ns);
+
+    bhm_destroy(map);
+
+    return status;
+}
+
+static void
+print_timing(const char *name, const struct timing *timing, const size_t iterations) {
+    fprintf(
+        stderr,
+        "%-28s %-14.3lf %-14.3lf %-14.3lf\n",
+        name,
+        timing->startup_ns / iterations / 1e6,
+        timing->access_ns / iterations / 1e6,
+        (timing->startup_ns + timing->access_ns) / iterations / 1e6
+    );
+}
+
+/* usage: ./prog <words.txt> [<snapshot path>] [<iterations>] */
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <words.txt> [<snapshot path>] [<iterations>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *snapshot_path = argc >= 3 ? argv[2] : DEFAULT_SNAPSHOT_PATH;
+    const size_t iterations = argc >= 4 ? atoll(argv[3]) : DEFAULT_ITER_COUNT;
+
+    FILE *words_file = fopen(argv[1], "r");
+    if (!words_file) {
+        return EXIT_FAILURE;
+    }
+
+    struct wordpair *words = malloc(WORDS_COUNT * sizeof(struct wordpair));
+    if (!words) {
+        fclose(words_file);
+        return EXIT_FAILURE;
+    }
+
+    size_t word_count = 0;
+    while (word_count < WORDS_COUNT && fgets(words[word_count].word, MAXWORDLEN, words_file)) {
+        words[word_count].len = strlen(words[word_count].word);
+        word_count += 1;
+    }
+
+    fclose(words_file);
+
+    /* the snapshot is written from a map holding the same words as the rebuilt one */
+    BHashMap *map = bhm_create(0, NULL);
+    if (!map) {
+        free(words);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < word_count; i++) {
+        bhm_set(map, words[i].word, words[i].len, (void *) (uintptr_t) (i + 1));
+    }
+
+    struct timespec time_start, time_end;
+
+    TIMER_GET(&time_start);
+    const bool saved = bhm_save(map, snapshot_path, 0);
+    TIMER_GET(&time_end);
+
+    bhm_destroy(map);
+
+    if (!saved) {
+        free(words);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(
+        stderr,
+        "Benchmark: Start up a map of %lu words and access each of them once\n"
+        "ITERATIONS: %lu\n"
+        "SNAPSHOT: %s (saved in %.3lfms)\n"
+        "------------------\n"
+        "%-28s %-14s %-14s %-14s\n",
+        word_count,
+        iterations,
+        snapshot_path,
+        TIMER_DIFF(time_start, time_end) / 1e6,
+        "STARTUP", "MS/STARTUP", "MS/ACCESS ALL", "MS/TOTAL"
+    );
+
+    struct timing rebuild = { 0 },
+                  open_warm = { 0 },
+                  open_cold = { 0 };
+
+    for (size_t i = 0; i < iterations; i++) {
+        if (bench_rebuild(words, word_count, &rebuild) != EXIT_SUCCESS
+            || bench_open(snapshot_path, false, words, word_count, &open_warm) != EXIT_SUCCESS
+            || bench_open(snapshot_path, true, words, word_count, &open_cold) != EXIT_SUCCESS) {
+            free(words);
+            return EXIT_FAILURE;
+        }
+    }
+
+    print_timing("rebuild (bhm_set)", &rebuild, iterations);
+    print_timing("bhm_open_mmap (page cache)", &open_warm, iterations);
+    print_timing("bhm_open_mmap (cold)", &open_cold, iterations);
+
+    free(words);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,903 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#include "bhashmap.h"
+
+#define TIMER_GET(s) clock_gettime(CLOCK_MONOTONIC_RAW, s);
+#define TIMER_DIFF(s, e) ((e.tv_sec * 1000000000 + e.tv_nsec) - (s.tv_sec * 1000000000 + s.tv_nsec))
+
+#define DEFAULT_SEED 42
+#define DEFAULT_OP_COUNT 1000000
+#define DEFAULT_MAX_SIZE 1000000
+#define MIN_SIZE 1000
+
+#define ZIPF_THETA 0.99
+
+#define SHORT_KEY_MIN 8
+#define SHORT_KEY_MAX 16
+#define LONG_KEY_MIN 64
+#define LONG_KEY_MAX 256
+
+/* every string key ends in its index, mixed and spelled out in this many base-64 digits, which makes it unique */
+#define KEY_SUFFIX_LEN 8
+#define KEY_SUFFIX_MASK ((1ull << (6 * KEY_SUFFIX_LEN)) - 1)
+
+enum key_kind {
+    KEYS_INT,
+    KEYS_SHORT,
+    KEYS_LONG,
+    KEY_KIND_COUNT
+};
+
+static const char *const KEY_KIND_NAMES[] = { "int", "short", "long" };
+
+static const struct {
+    const char *name;
+    BHashMapBackend backend;
+} BACKENDS[] = {
+    { "chain", BHM_BACKEND_CHAINING },
+    { "open", BHM_BACKEND_OPEN_ADDRESSING },
+    { "dense", BHM_BACKEND_DENSE }
+};
+
+#define BACKEND_COUNT (sizeof(BACKENDS) / sizeof(BACKENDS[0]))
+
+/*
+2 * size keys of one kind: keys [0, size) are inserted into the maps, keys [size, 2 * size) never
+are and serve as misses. Integer keys are stored as such, string keys back to back in one buffer.
+*/
+struct keyset {
+    enum key_kind kind;
+    size_t count;
+
+    uint64_t *ints;
+
+    unsigned char *bytes;
+    uint64_t *offsets;
+    uint16_t *lens;
+};
+
+struct context {
+    const struct keyset *keys;
+    size_t size,
+           op_count;
+    BHashMapConfig config;
+
+    /* indices of the keys accessed by the lookup workloads, drawn before the clock starts */
+    const uint64_t *uniform,
+                   *zipf,
+                   *universe;
+};
+
+/* hardware counters of the calling thread, read as one group */
+enum counter {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_CACHE_MISSES,
+    COUNTER_COUNT
+};
+
+struct counters {
+    int fds[COUNTER_COUNT];
+    bool available;
+};
+
+struct result {
+    uint64_t op_count,
+             ns;
+    uint64_t counters[COUNTER_COUNT];
+    bool has_counters;
+
+    size_t resize_count;
+    uint64_t resize_ns;
+    size_t map_bytes,
+           peak_rss_kb;
+};
+
+struct run {
+    struct timespec time_start;
+    struct result *result;
+
+    /* to report only the resizes of the timed operations, not those of filling the map */
+    size_t resize_count;
+    uint64_t resize_ns;
+};
+
+static struct counters counters;
+static volatile uintptr_t sink;
+
+static inline uint64_t
+splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/* bijective, so that distinct indices make distinct keys */
+static inline uint64_t
+mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+/* bijective on [0, 2^48), for the suffixes of string keys */
+static inline uint64_t
+mix48(uint64_t x) {
+    x = (x * 0x9e3779b97f4bull) & KEY_SUFFIX_MASK;
+    x ^= x >> 23;
+    x = (x * 0xbf58476d1ce5ull) & KEY_SUFFIX_MASK;
+    return x ^ (x >> 29);
+}
+
+/* a uniform number in [0, n) */
+static inline uint64_t
+below(uint64_t *state, const uint64_t n) {
+    return (uint64_t) (((unsigned __int128) splitmix64(state) * n) >> 64);
+}
+
+static inline const void *
+key_at(const struct keyset *keys, const size_t idx, size_t *keylen) {
+    if (keys->kind == KEYS_INT) {
+        *keylen = sizeof(uint64_t);
+        return &keys->ints[idx];
+    }
+
+    *keylen = keys->lens[idx];
+    return keys->bytes + keys->offsets[idx];
+}
+
+static void
+keyset_free(struct keyset *keys) {
+    free(keys->ints);
+    free(keys->bytes);
+    free(keys->offsets);
+    free(keys->lens);
+}
+
+static bool
+keyset_make(struct keyset *keys, const enum key_kind kind, const size_t count, const uint64_t seed) {
+    static const char DIGITS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+    *keys = (struct keyset) {
+        .kind = kind,
+        .count = count
+    };
+
+    uint64_t state = seed;
+
+    if (kind == KEYS_INT) {
+        keys->ints = malloc(count * sizeof(uint64_t));
+        if (!keys->ints) {
+            return false;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            keys->ints[i] = mix64(i ^ seed);
+        }
+
+        return true;
+    }
+
+    const size_t len_min = kind == KEYS_SHORT ? SHORT_KEY_MIN : LONG_KEY_MIN,
+                 len_max = kind == KEYS_SHORT ? SHORT_KEY_MAX : LONG_KEY_MAX;
+
+    keys->offsets = malloc(count * sizeof(uint64_t));
+    keys->lens = malloc(count * sizeof(uint16_t));
+    keys->bytes = malloc(count * len_max);
+
+    if (!keys->offsets || !keys->lens || !keys->bytes) {
+        keyset_free(keys);
+        return false;
+    }
+
+    uint64_t offset = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const size_t len = len_min + below(&state, len_max - len_min + 1);
+        unsigned char *key = keys->bytes + offset;
+
+        for (size_t j = 0; j < len - KEY_SUFFIX_LEN; j++) {
+            key[j] = DIGITS[below(&state, 64)];
+        }
+
+        uint64_t suffix = mix48(i);
+        for (size_t j = len - KEY_SUFFIX_LEN; j < len; j++) {
+            key[j] = DIGITS[suffix & 63];
+            suffix >>= 6;
+        }
+
+        keys->offsets[i] = offset;
+        keys->lens[i] = len;
+        offset += len;
+    }
+
+    return true;
+}
+
+/* "count" indices in [0, n), uniformly distributed */
+static uint64_t *
+draw_uniform(const size_t n, const size_t count, uint64_t seed) {
+    uint64_t *indices = malloc(count * sizeof(uint64_t));
+    if (!indices) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        indices[i] = below(&seed, n);
+    }
+
+    return indices;
+}
+
+/*
+"count" indices in [0, n) whose ranks follow a Zipfian distribution, drawn with the method of Gray
+et al. ("Quickly generating billion-record synthetic databases") as in YCSB. Ranks are scattered
+over the keys, so that the hot keys aren't the ones inserted first.
+*/
+static uint64_t *
+draw_zipf(const size_t n, const size_t count, uint64_t seed) {
+    uint64_t *indices = malloc(count * sizeof(uint64_t));
+    if (!indices) {
+        return NULL;
+    }
+
+    double zeta_n = 0;
+    for (size_t i = 1; i <= n; i++) {
+        zeta_n += 1 / pow((double) i, ZIPF_THETA);
+    }
+
+    const double zeta_2 = 1 + 1 / pow(2, ZIPF_THETA),
+                 alpha = 1 / (1 - ZIPF_THETA),
+                 eta = (1 - pow(2.0 / (double) n, 1 - ZIPF_THETA)) / (1 - zeta_2 / zeta_n);
+
+    for (size_t i = 0; i < count; i++) {
+        const double u = (double) (splitmix64(&seed) >> 11) / (double) (1ull << 53),
+                     uz = u * zeta_n;
+
+        uint64_t rank;
+        if (uz < 1) {
+            rank = 0;
+        } else if (uz < zeta_2) {
+            rank = 1;
+        } else {
+            rank = (uint64_t) ((double) n * pow(eta * u - eta + 1, alpha));
+        }
+
+        if (rank >= n) {
+            rank = n - 1;
+        }
+
+        indices[i] = (uint64_t) (((unsigned __int128) mix64(rank ^ seed) * n) >> 64);
+    }
+
+    return indices;
+}
+
+static int
+perf_open(const uint64_t config, const int group_fd) {
+    struct perf_event_attr attr = {
+        .type = PERF_TYPE_HARDWARE,
+        .size = sizeof(struct perf_event_attr),
+        .config = config,
+        .disabled = group_fd == -1,
+        .exclude_kernel = 1,
+        .exclude_hv = 1,
+        .read_format = PERF_FORMAT_GROUP
+    };
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/* the counters are reported as missing if the kernel (or its perf_event_paranoid setting) won't open them */
+static void
+counters_open(struct counters *counters) {
+    static const uint64_t CONFIGS[COUNTER_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES
+    };
+
+    counters->available = true;
+
+    for (size_t c = 0; c < COUNTER_COUNT; c++) {
+        counters->fds[c] = perf_open(CONFIGS[c], c == 0 ? -1 : counters->fds[0]);
+        counters->available &= counters->fds[c] >= 0;
+    }
+}
+
+/* reset the peak RSS of the process to its current RSS, so that it can be measured per workload */
+static void
+peak_rss_reset(void) {
+    FILE *file = fopen("/proc/self/clear_refs", "w");
+    if (file) {
+        fputs("5", file);
+        fclose(file);
+    }
+}
+
+static size_t
+peak_rss_kb(void) {
+    FILE *file = fopen("/proc/self/status", "r");
+    char line[256];
+    size_t kb = 0;
+
+    while (file && fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "VmHWM: %lu kB", &kb) == 1) {
+            break;
+        }
+    }
+
+    if (file) {
+        fclose(file);
+    }
+
+    if (kb == 0) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        kb = usage.ru_maxrss;
+    }
+
+    return kb;
+}
+
+static void
+run_begin(struct run *run, const BHashMap *map, struct result *result, const uint64_t op_count) {
+    BHashMapStats stats;
+    bhm_get_stats(map, &stats);
+
+    *run = (struct run) {
+        .result = result,
+        .resize_count = stats.resize_count,
+        .resize_ns = stats.resize_ns
+    };
+
+    result->op_count = op_count;
+
+    if (counters.available) {
+        ioctl(counters.fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(counters.fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    TIMER_GET(&run->time_start);
+}
+
+static void
+run_end(struct run *run, const BHashMap *map) {
+    struct timespec time_end;
+    TIMER_GET(&time_end);
+
+    struct result *result = run->result;
+    result->ns = TIMER_DIFF(run->time_start, time_end);
+
+    if (counters.available) {
+        ioctl(counters.fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        uint64_t values[1 + COUNTER_COUNT];
+        if (read(counters.fds[0], values, sizeof(values)) == sizeof(values)) {
+            memcpy(result->counters, &values[1], sizeof(result->counters));
+            result->has_counters = true;
+        }
+    }
+
+    BHashMapStats stats;
+    bhm_get_stats(map, &stats);
+
+    result->resize_count = stats.resize_count - run->resize_count;
+    result->resize_ns = stats.resize_ns - run->resize_ns;
+    result->map_bytes = stats.table_bytes + stats.node_bytes + stats.key_bytes + stats.arena_bytes;
+    result->peak_rss_kb = peak_rss_kb();
+}
+
+static BHashMap *
+create_filled(const struct context *ctx) {
+    BHashMap *map = bhm_create(0, &ctx->config);
+
+    for (size_t i = 0; map && i < ctx->size; i++) {
+        size_t keylen;
+        const void *key = key_at(ctx->keys, i, &keylen);
+
+        if (!bhm_set(map, key, keylen, (void *) (uintptr_t) (i + 1))) {
+            bhm_destroy(map);
+            return NULL;
+        }
+    }
+
+    return map;
+}
+
+static bool
+insert_keys(const struct context *ctx, struct result *result, const bool reserve) {
+    BHashMap *map = bhm_create(0, &ctx->config);
+    if (!map) {
+        return false;
+    }
+
+    struct run run;
+    run_begin(&run, map, result, ctx->size);
+
+    bool ok = !reserve || bhm_reserve(map, ctx->size);
+
+    for (size_t i = 0; ok && i < ctx->size; i++) {
+        size_t keylen;
+        const void *key = key_at(ctx->keys, i, &keylen);
+
+        ok = bhm_set(map, key, keylen, (void *) (uintptr_t) (i + 1));
+    }
+
+    run_end(&run, map);
+    bhm_destroy(map);
+
+    return ok;
+}
+
+/* insert every key into an empty map, resizing along the way */
+static bool
+workload_insert(const struct context *ctx, struct result *result) {
+    return insert_keys(ctx, result, false);
+}
+
+/* the same with the table sized up front: the difference to "insert" is the cost of resizing */
+static bool
+workload_insert_reserved(const struct context *ctx, struct result *result) {
+    return insert_keys(ctx, result, true);
+}
+
+/* look up the keys at "indices", offset by "base" (ctx->size for misses) */
+static bool
+lookup_keys(const struct context *ctx, struct result *result, const uint64_t *indices, const size_t base) {
+    BHashMap *map = create_filled(ctx);
+    if (!map) {
+        return false;
+    }
+
+    uintptr_t sum = 0;
+
+    struct run run;
+    run_begin(&run, map, result, ctx->op_count);
+
+    for (size_t i = 0; i < ctx->op_count; i++) {
+        size_t keylen;
+        const void *key = key_at(ctx->keys, base + indices[i], &keylen);
+
+        sum += (uintptr_t) bhm_get(map, key, keylen);
+    }
+
+    run_end(&run, map);
+    bhm_destroy(map);
+
+    sink = sum;
+
+    /* every hit returns a non-zero value, every miss NULL */
+    return base == 0 ? sum > 0 : sum == 0;
+}
+
+static bool
+workload_get_hit_uniform(const struct context *ctx, struct result *result) {
+    return lookup_keys(ctx, result, ctx->uniform, 0);
+}
+
+static bool
+workload_get_hit_zipf(const struct context *ctx, struct result *result) {
+    return lookup_keys(ctx, result, ctx->zipf, 0);
+}
+
+static bool
+workload_get_miss(const struct context *ctx, struct result *result) {
+    return lookup_keys(ctx, result, ctx->uniform, ctx->size);
+}
+
+/*
+Operations on keys drawn uniformly from all 2 * size keys, half of which start out in the map:
+"get_percent" percent lookups and the rest split evenly between inserts and removals, which keeps
+the map at about its initial size.
+*/
+static bool
+mixed(const struct context *ctx, struct result *result, const unsigned get_percent) {
+    BHashMap *map = create_filled(ctx);
+    if (!map) {
+        return false;
+    }
+
+    const unsigned set_percent = get_percent + (100 - get_percent) / 2;
+    uintptr_t sum = 0;
+
+    struct run run;
+    run_begin(&run, map, result, ctx->op_count);
+
+    for (size_t i = 0; i < ctx->op_count; i++) {
+        const uint64_t idx = ctx->universe[i];
+        const unsigned kind = mix64(i) % 100;
+
+        size_t keylen;
+        const void *key = key_at(ctx->keys, idx, &keylen);
+
+        if (kind < get_percent) {
+            sum += (uintptr_t) bhm_get(map, key, keylen);
+        } else if (kind < set_percent) {
+            sum += bhm_set(map, key, keylen, (void *) (uintptr_t) (idx + 1));
+        } else {
+            sum += bhm_remove(map, key, keylen);
+        }
+    }
+
+    run_end(&run, map);
+    bhm_destroy(map);
+
+    sink = sum;
+
+    return true;
+}
+
+static bool
+workload_mixed_90_5_5(const struct context *ctx, struct result *result) {
+    return mixed(ctx, result, 90);
+}
+
+static bool
+workload_mixed_50_25_25(const struct context *ctx, struct result *result) {
+    return mixed(ctx, result, 50);
+}
+
+/* remove a key and insert it right back, cycling through the keys; each counts as two operations */
+static bool
+workload_churn(const struct context *ctx, struct result *result) {
+    BHashMap *map = create_filled(ctx);
+    if (!map) {
+        return false;
+    }
+
+    bool ok = true;
+
+    struct run run;
+    run_begin(&run, map, result, ctx->op_count / 2 * 2);
+
+    for (size_t i = 0; i < ctx->op_count / 2; i++) {
+        const uint64_t idx = ctx->uniform[i];
+
+        size_t keylen;
+        const void *key = key_at(ctx->keys, idx, &keylen);
+
+        ok &= bhm_remove(map, key, keylen);
+        ok &= bhm_set(map, key, keylen, (void *) (uintptr_t) (idx + 1));
+    }
+
+    run_end(&run, map);
+    bhm_destroy(map);
+
+    return ok;
+}
+
+/*
+Count the occurrences of keys drawn with Zipfian access in a map that starts out empty, like a word
+count: either with a bhm_get followed by a bhm_set, or with a single bhm_get_or_insert.
+*/
+static bool
+count_keys(const struct context *ctx, struct result *result, const bool single_lookup) {
+    BHashMap *map = bhm_create(0, &ctx->config);
+    if (!map) {
+        return false;
+    }
+
+    bool ok = true;
+
+    struct run run;
+    run_begin(&run, map, result, ctx->op_count);
+
+    for (size_t i = 0; ok && i < ctx->op_count; i++) {
+        size_t keylen;
+        const void *key = key_at(ctx->keys, ctx->zipf[i], &keylen);
+
+        if (single_lookup) {
+            void **count = bhm_get_or_insert(map, key, keylen, NULL, NULL);
+
+            ok = count != NULL;
+            if (ok) {
+                *count = (void *) ((uintptr_t) *count + 1);
+            }
+        } else {
+            const uintptr_t count = (uintptr_t) bhm_get(map, key, keylen);
+
+            ok = bhm_set(map, key, keylen, (void *) (count + 1));
+        }
+    }
+
+    run_end(&run, map);
+    bhm_destroy(map);
+
+    return ok;
+}
+
+static bool
+workload_count_get_set(const struct context *ctx, struct result *result) {
+    return count_keys(ctx, result, false);
+}
+
+static bool
+workload_count_get_or_insert(const struct context *ctx, struct result *result) {
+    return count_keys(ctx, result, true);
+}
+
+static const struct {
+    const char *name;
+    bool (*run)(const struct context *ctx, struct result *result);
+} WORKLOADS[] = {
+    { "insert", workload_insert },
+    { "insert_reserved", workload_insert_reserved },
+    { "get_hit_uniform", workload_get_hit_uniform },
+    { "get_hit_zipf", workload_get_hit_zipf },
+    { "get_miss", workload_get_miss },
+    { "mixed_90_5_5", workload_mixed_90_5_5 },
+    { "mixed_50_25_25", workload_mixed_50_25_25 },
+    { "churn", workload_churn },
+    { "count_get_set", workload_count_get_set },
+    { "count_get_or_insert", workload_count_get_or_insert }
+};
+
+#define WORKLOAD_COUNT (sizeof(WORKLOADS) / sizeof(WORKLOADS[0]))
+
+static const char *const COLUMNS[] = {
+    "workload", "backend", "keys", "size", "ops", "ns_per_op", "cycles_per_op", "instructions_per_op",
+    "cache_misses_per_op", "resize_count", "resize_ms", "map_bytes", "peak_rss_kb"
+};
+
+#define COLUMN_COUNT (sizeof(COLUMNS) / sizeof(COLUMNS[0]))
+
+static void
+print_header(FILE *out, const bool json, const uint64_t seed, const size_t op_count) {
+    if (json) {
+        fprintf(out, "{\n  \"seed\": %lu,\n  \"ops\": %lu,\n  \"results\": [", seed, op_count);
+        return;
+    }
+
+    for (size_t c = 0; c < COLUMN_COUNT; c++) {
+        fprintf(out, "%s%s", COLUMNS[c], c + 1 < COLUMN_COUNT ? "," : "\n");
+    }
+}
+
+static void
+print_result(FILE *out, const bool json, const bool first, const char *workload, const char *backend, const char *keys, const size_t size, const struct result *result) {
+    const double ops = result->op_count > 0 ? (double) result->op_count : 1;
+
+    char counter_values[COUNTER_COUNT][32];
+    for (size_t c = 0; c < COUNTER_COUNT; c++) {
+        if (result->has_counters) {
+            snprintf(counter_values[c], sizeof(counter_values[c]), "%.2f", (double) result->counters[c] / ops);
+        } else {
+            snprintf(counter_values[c], sizeof(counter_values[c]), "%s", json ? "null" : "");
+        }
+    }
+
+    const char *format = json
+        ? "%s\n    {\"workload\": \"%s\", \"backend\": \"%s\", \"keys\": \"%s\", \"size\": %lu, \"ops\": %lu, \"ns_per_op\": %.2f, "
+          "\"cycles_per_op\": %s, \"instructions_per_op\": %s, \"cache_misses_per_op\": %s, \"resize_count\": %lu, "
+          "\"resize_ms\": %.3f, \"map_bytes\": %lu, \"peak_rss_kb\": %lu}"
+        : "%s%s,%s,%s,%lu,%lu,%.2f,%s,%s,%s,%lu,%.3f,%lu,%lu\n";
+
+    fprintf(
+        out,
+        format,
+        json ? (first ? "" : ",") : "",
+        workload,
+        backend,
+        keys,
+        size,
+        result->op_count,
+        (double) result->ns / ops,
+        counter_values[COUNTER_CYCLES],
+        counter_values[COUNTER_INSTRUCTIONS],
+        counter_values[COUNTER_CACHE_MISSES],
+        result->resize_count,
+        result->resize_ns / 1e6,
+        result->map_bytes,
+        result->peak_rss_kb
+    );
+
+    fflush(out);
+}
+
+/* whether "name" is in the comma-separated "list", or "list" is NULL or "all" */
+static bool
+selected(const char *list, const char *name) {
+    if (!list || strcmp(list, "all") == 0) {
+        return true;
+    }
+
+    const size_t len = strlen(name);
+
+    for (const char *item = list; item; item = strchr(item, ',') ? strchr(item, ',') + 1 : NULL) {
+        if (strncmp(item, name, len) == 0 && (item[len] == ',' || item[len] == '\0')) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void
+usage(const char *prog) {
+    fprintf(
+        stderr,
+        "usage: %s [options]\n"
+        "  --format csv|json        output format (default: csv)\n"
+        "  --max-size N             run sizes 1000, 10000, ... up to N keys (default: %d)\n"
+        "  --sizes N,N,...          run exactly these sizes instead\n"
+        "  --ops N                  operations per lookup/mixed/churn workload (default: %d)\n"
+        "  --seed N                 seed of the keysets, access patterns and maps (default: %d)\n"
+        "  --backends LIST          chain,open,dense (default: all)\n"
+        "  --keys LIST              int,short,long (default: all)\n"
+        "  --workloads LIST         insert,insert_reserved,get_hit_uniform,get_hit_zipf,get_miss,\n"
+        "                           mixed_90_5_5,mixed_50_25_25,churn,count_get_set,\n"
+        "                           count_get_or_insert (default: all)\n",
+        prog,
+        DEFAULT_MAX_SIZE,
+        DEFAULT_OP_COUNT,
+        DEFAULT_SEED
+    );
+}
+
+/* usage: ./prog [--format csv|json] [--max-size N] [--sizes N,...] [--ops N] [--seed N] [--backends LIST] [--keys LIST] [--workloads LIST] */
+int main(int argc, char **argv) {
+    bool json = false;
+    size_t max_size = DEFAULT_MAX_SIZE,
+           op_count = DEFAULT_OP_COUNT;
+    uint64_t seed = DEFAULT_SEED;
+    const char *sizes_list = NULL,
+               *backends_list = NULL,
+               *keys_list = NULL,
+               *workloads_list = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (!value) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        if (strcmp(argv[i], "--format") == 0) {
+            json = strcmp(value, "json") == 0;
+        } else if (strcmp(argv[i], "--max-size") == 0) {
+            max_size = strtoull(value, NULL, 10);
+        } else if (strcmp(argv[i], "--sizes") == 0) {
+            sizes_list = value;
+        } else if (strcmp(argv[i], "--ops") == 0) {
+            op_count = strtoull(value, NULL, 10);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            seed = strtoull(value, NULL, 10);
+        } else if (strcmp(argv[i], "--backends") == 0) {
+            backends_list = value;
+        } else if (strcmp(argv[i], "--keys") == 0) {
+            keys_list = value;
+        } else if (strcmp(argv[i], "--workloads") == 0) {
+            workloads_list = value;
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        i += 1;
+    }
+
+    size_t sizes[32],
+           size_count = 0;
+
+    if (sizes_list) {
+        for (const char *item = sizes_list; item && size_count < 32; item = strchr(item, ',') ? strchr(item, ',') + 1 : NULL) {
+            sizes[size_count++] = strtoull(item, NULL, 10);
+        }
+    } else {
+        for (size_t size = MIN_SIZE; size <= max_size && size_count < 32; size *= 10) {
+            sizes[size_count++] = size;
+        }
+    }
+
+    if (size_count == 0 || op_count == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    counters_open(&counters);
+
+    fprintf(
+        stderr,
+        "Benchmark suite: seed %lu, %lu operations per workload, hardware counters %s\n",
+        seed,
+        op_count,
+        counters.available ? "available" : "unavailable"
+    );
+
+    print_header(stdout, json, seed, op_count);
+
+    bool first = true;
+
+    for (size_t s = 0; s < size_count; s++) {
+        const size_t size = sizes[s];
+
+        if (size == 0) {
+            continue;
+        }
+
+        /* the access patterns only depend on the size, so every keyset and backend replays the same one */
+        uint64_t *uniform = draw_uniform(size, op_count, seed ^ 0x1),
+                 *zipf = draw_zipf(size, op_count, seed ^ 0x2),
+                 *universe = draw_uniform(2 * size, op_count, seed ^ 0x3);
+
+        if (!uniform || !zipf || !universe) {
+            fprintf(stderr, "out of memory for %lu keys\n", size);
+            return EXIT_FAILURE;
+        }
+
+        for (size_t k = 0; k < KEY_KIND_COUNT; k++) {
+            if (!selected(keys_list, KEY_KIND_NAMES[k])) {
+                continue;
+            }
+
+            struct keyset keys;
+            if (!keyset_make(&keys, k, 2 * size, seed)) {
+                fprintf(stderr, "out of memory for %lu %s keys\n", size, KEY_KIND_NAMES[k]);
+                return EXIT_FAILURE;
+            }
+
+            for (size_t b = 0; b < BACKEND_COUNT; b++) {
+                if (!selected(backends_list, BACKENDS[b].name)) {
+                    continue;
+                }
+
+                const struct context ctx = {
+                    .keys = &keys,
+                    .size = size,
+                    .op_count = op_count,
+                    .config = {
+                        .backend = BACKENDS[b].backend,
+                        /* a fixed hash seed, so that the maps are laid out the same in every run */
+                        .seed = seed | 1
+                    },
+                    .uniform = uniform,
+                    .zipf = zipf,
+                    .universe = universe
+                };
+
+                for (size_t w = 0; w < WORKLOAD_COUNT; w++) {
+                    if (!selected(workloads_list, WORKLOADS[w].name)) {
+                        continue;
+                    }
+
+                    struct result result = { 0 };
+
+                    peak_rss_reset();
+
+                    if (!WORKLOADS[w].run(&ctx, &result)) {
+                        fprintf(stderr, "%s failed (%s, %s keys, %lu)\n", WORKLOADS[w].name, BACKENDS[b].name, KEY_KIND_NAMES[k], size);
+                        return EXIT_FAILURE;
+                    }
+
+                    print_result(stdout, json, first, WORKLOADS[w].name, BACKENDS[b].name, KEY_KIND_NAMES[k], size, &result);
+                    first = false;
+                }
+            }
+
+            keyset_free(&keys);
+        }
+
+        free(uniform);
+        free(zipf);
+        free(universe);
+    }
+
+    if (json) {
+        printf("\n  ]\n}\n");
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -2,7 +2,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "bhashmap.h"
+#include "bhashmap_concurrent.h"
+#include "bhashmap_sharded.h"
 
 #define TIMER_GET(s) clock_gettime(CLOCK_MONOTONIC_RAW, s);
 #define TIMER_DIFF(s, e) ((e.tv_sec * 1000000000 + e.tv_nsec) - (s.tv_sec * 1000000000 + s.tv_nsec))
@@ -12,8 +18,25 @@
 
 #define DEFAULT_ITER_COUNT 16
 
+/* number of keys passed to a single bhm_get_batch call in the access_batch benchmark */
+#define BATCH_SIZE 256
+
 static BHashMapConfig hashmap_config; // zeroed-out by default
 
+/* plain malloc allocator hook, to compare against the built-in arena */
+static void *
+malloc_allocate(void *ctx, size_t size) {
+    (void) ctx;
+    return malloc(size);
+}
+
+static void
+malloc_deallocate(void *ctx, void *ptr, size_t size) {
+    (void) ctx;
+    (void) size;
+    free(ptr);
+}
+
 int access_all(size_t iterations, const char *path) {
     fprintf(
         stderr,
@@ -93,6 +116,108 @@ int access_all(size_t iterations, const char *path) {
     return EXIT_SUCCESS;
 }
 
+/* same as access_all, but looks the keys up through bhm_get_batch */
+int access_batch(size_t iterations, const char *path) {
+    fprintf(
+        stderr,
+        "Benchmark: Access keys of all %d words in batches of %d\n"
+        "ITERATIONS: %lu\n"
+        "WORDS.TXT path: %s\n"
+        "------------------\n",
+        WORDS_COUNT,
+        BATCH_SIZE,
+        iterations,
+        path
+    );
+
+    struct wordpair {
+        char word[MAXWORDLEN];
+        size_t len;
+    };
+
+    /* load all the words into memory and insert them into the hashmap as keys */
+    FILE *words_file = fopen(path, "r");
+    if (!words_file) {
+        return EXIT_FAILURE;
+    }
+
+    struct wordpair *words = malloc(WORDS_COUNT * sizeof(struct wordpair));
+    if (!words) {
+        fclose(words_file);
+        return EXIT_FAILURE;
+    }
+
+    size_t i = 0;
+    while (fgets(words[i].word, MAXWORDLEN, words_file)) {
+        words[i].len = strlen(words[i].word);
+        i += 1;
+    }
+
+    fclose(words_file);
+
+    BHashMap *map = bhm_create(0, &hashmap_config);
+    if (!map) {
+        free(words);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t j = 0; j < WORDS_COUNT; j++) {
+        bhm_set(map, words[j].word, words[j].len, (void *) 0x1234);
+    }
+
+    const void **keys = malloc(WORDS_COUNT * sizeof(*keys));
+    size_t *keylens = malloc(WORDS_COUNT * sizeof(*keylens));
+    void **values = malloc(WORDS_COUNT * sizeof(*values));
+    if (!keys || !keylens || !values) {
+        free(keys);
+        free(keylens);
+        free(values);
+        bhm_destroy(map);
+        free(words);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t j = 0; j < WORDS_COUNT; j++) {
+        keys[j] = words[j].word;
+        keylens[j] = words[j].len;
+    }
+
+    /* ---------------------------------------- */
+
+    struct timespec time_start, time_end;
+    size_t ns_total = 0;    
+
+    for (size_t i = 0; i < iterations; i++) {
+        TIMER_GET(&time_start);
+
+        for (size_t j = 0; j < WORDS_COUNT; j += BATCH_SIZE) {
+            const size_t n = WORDS_COUNT - j < BATCH_SIZE ? WORDS_COUNT - j : BATCH_SIZE;
+            bhm_get_batch(map, &keys[j], &keylens[j], &values[j], n);
+        }
+
+        TIMER_GET(&time_end);
+        ns_total += TIMER_DIFF(time_start, time_end);
+    }
+
+    bhm_destroy(map);
+
+    fprintf(
+        stderr,
+        "%-30s: %lums\n"
+        "%-30s: %luns\n",
+        "RUNTIME:",
+        ns_total / iterations / 1000000,
+        "AVG. TIME TO ACCESS KEY:",
+        ns_total / iterations / WORDS_COUNT
+    );
+
+    free(keys);
+    free(keylens);
+    free(values);
+    free(words);
+    return EXIT_SUCCESS;
+}
+
 int insert_all_create_destroy(size_t iterations, const char *path) {
     fprintf(
         stderr,
@@ -160,6 +285,114 @@ int insert_all_create_destroy(size_t iterations, const char *path) {
     return EXIT_SUCCESS;
 }
 
+/*
+Build a map of all words three ways: one bhm_set per word into a map that grows as it goes, the
+same after reserving room for all the words with bhm_reserve, and with a single bhm_build call.
+*/
+int build_all(size_t iterations, const char *path) {
+    fprintf(
+        stderr,
+        "Benchmark: Build a hashmap of all %d words\n"
+        "ITERATIONS: %lu\n"
+        "WORDS.TXT path: %s\n"
+        "------------------\n",
+        WORDS_COUNT,
+        iterations,
+        path
+    );
+
+    struct wordpair {
+        char word[MAXWORDLEN];
+        size_t len;
+    };
+
+    /* load all the words into memory */
+    FILE *words_file = fopen(path, "r");
+    if (!words_file) {
+        return EXIT_FAILURE;
+    }
+
+    struct wordpair *words = malloc(WORDS_COUNT * sizeof(struct wordpair));
+    const void **keys = malloc(WORDS_COUNT * sizeof(void *)),
+               **values = malloc(WORDS_COUNT * sizeof(void *));
+    size_t *keylens = malloc(WORDS_COUNT * sizeof(size_t));
+
+    if (!words || !keys || !values || !keylens) {
+        fclose(words_file);
+        free(words);
+        free(keys);
+        free(values);
+        free(keylens);
+        return EXIT_FAILURE;
+    }
+
+    size_t i = 0;
+    while (fgets(words[i].word, MAXWORDLEN, words_file)) {
+        words[i].len = strlen(words[i].word);
+        keys[i] = words[i].word;
+        keylens[i] = words[i].len;
+        values[i] = (void *) 0x1234;
+        i += 1;
+    }
+
+    fclose(words_file);
+    /* ---------------------------------------- */
+
+    struct timespec time_start, time_end;
+    size_t ns_set = 0,
+           ns_reserve = 0,
+           ns_build = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        TIMER_GET(&time_start);
+        BHashMap *map = bhm_create(0, &hashmap_config);
+        for (size_t j = 0; j < WORDS_COUNT; j++) {
+            bhm_set(map, words[j].word, words[j].len, (void *) 0x1234);
+        }
+        TIMER_GET(&time_end);
+        ns_set += TIMER_DIFF(time_start, time_end);
+        bhm_destroy(map);
+
+        TIMER_GET(&time_start);
+        map = bhm_create(0, &hashmap_config);
+        bhm_reserve(map, WORDS_COUNT);
+        for (size_t j = 0; j < WORDS_COUNT; j++) {
+            bhm_set(map, words[j].word, words[j].len, (void *) 0x1234);
+        }
+        TIMER_GET(&time_end);
+        ns_reserve += TIMER_DIFF(time_start, time_end);
+        bhm_destroy(map);
+
+        TIMER_GET(&time_start);
+        map = bhm_build((const void *const *) keys, keylens, (const void *const *) values, WORDS_COUNT, &hashmap_config);
+        TIMER_GET(&time_end);
+        ns_build += TIMER_DIFF(time_start, time_end);
+
+        if (!map || bhm_count(map) != WORDS_COUNT) {
+            return EXIT_FAILURE;
+        }
+
+        bhm_destroy(map);
+    }
+
+    fprintf(
+        stderr,
+        "%-30s: %.3lfms\n"
+        "%-30s: %.3lfms\n"
+        "%-30s: %.3lfms\n",
+        "bhm_set:", ns_set / iterations / 1e6,
+        "bhm_reserve + bhm_set:", ns_reserve / iterations / 1e6,
+        "bhm_build:", ns_build / iterations / 1e6
+    );
+
+    free(words);
+    free(keys);
+    free(values);
+    free(keylens);
+
+    return EXIT_SUCCESS;
+}
+
 int insert_all(size_t iterations, const char *path) {
     fprintf(
         stderr,
@@ -230,7 +463,396 @@ int insert_all(size_t iterations, const char *path) {
     return EXIT_SUCCESS;
 }
 
-/* usage: ./prog <type> <words.txt_file_path> [<iterations>] [<max_load_factor>] [<resize_growth_factor>] */
+static int
+compare_u64(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *) a,
+                   y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+int insert_latency(size_t iterations, const char *path) {
+    fprintf(
+        stderr,
+        "Benchmark: Latency distribution of inserting all %d words as keys\n"
+        "ITERATIONS: %lu\n"
+        "WORDS.TXT path: %s\n"
+        "------------------\n",
+        WORDS_COUNT,
+        iterations,
+        path
+    );
+
+    struct wordpair {
+        char word[MAXWORDLEN];
+        size_t len;
+    };
+
+    /* load all the words into memory */
+    FILE *words_file = fopen(path, "r");
+    if (!words_file) {
+        return EXIT_FAILURE;
+    }
+
+    struct wordpair *words = malloc(WORDS_COUNT * sizeof(struct wordpair));
+    uint64_t *latencies = malloc(WORDS_COUNT * iterations * sizeof(uint64_t));
+    if (!words || !latencies) {
+        free(words);
+        free(latencies);
+        fclose(words_file);
+        return EXIT_FAILURE;
+    }
+
+    size_t i = 0;
+    while (fgets(words[i].word, MAXWORDLEN, words_file)) {
+        words[i].len = strlen(words[i].word);
+        i += 1;
+    }
+
+    fclose(words_file);
+    /* ---------------------------------------- */
+
+    struct timespec time_start, time_end;
+
+    for (size_t i = 0; i < iterations; i++) {
+        BHashMap *map = bhm_create(0, &hashmap_config);
+
+        for (size_t j = 0; j < WORDS_COUNT; j++) {
+            TIMER_GET(&time_start);
+            bhm_set(map, words[j].word, words[j].len, (void const *) 0x1234);
+            TIMER_GET(&time_end);
+
+            latencies[i * WORDS_COUNT + j] = TIMER_DIFF(time_start, time_end);
+        }
+
+        bhm_destroy(map);
+    }
+
+    const size_t n = WORDS_COUNT * iterations;
+    qsort(latencies, n, sizeof(uint64_t), compare_u64);
+
+    fprintf(
+        stderr,
+        "%-30s: %luns\n"
+        "%-30s: %luns\n"
+        "%-30s: %luns\n"
+        "%-30s: %luns\n",
+        "P50 INSERT LATENCY:",
+        latencies[n / 2],
+        "P99 INSERT LATENCY:",
+        latencies[n / 100 * 99],
+        "P99.9 INSERT LATENCY:",
+        latencies[n / 1000 * 999],
+        "MAX INSERT LATENCY:",
+        latencies[n - 1]
+    );
+
+    free(latencies);
+    free(words);
+    return EXIT_SUCCESS;
+}
+
+struct concurrent_worker {
+    const void *words;
+    size_t word_size,
+           len_offset,
+           passes,
+           offset;
+    BHashMapConcurrent *cmap;
+    BHashMapSharded *smap;
+    BHashMap *map;
+    pthread_mutex_t *map_lock;
+};
+
+/* every 10th operation is a set, the rest are gets; each thread starts at a different word */
+static void *
+concurrent_worker_run(void *arg) {
+    const struct concurrent_worker *w = arg;
+
+    for (size_t pass = 0; pass < w->passes; pass++) {
+        for (size_t k = 0; k < WORDS_COUNT; k++) {
+            const size_t j = (k + w->offset) % WORDS_COUNT;
+            const char *word = (const char *) w->words + j * w->word_size;
+            const size_t len = *(const size_t *) (word + w->len_offset);
+
+            if (w->cmap) {
+                if (k % 10 == 0) {
+                    bhm_concurrent_set(w->cmap, word, len, (void *) 0x1234);
+                } else {
+                    bhm_concurrent_get(w->cmap, word, len);
+                }
+            } else if (w->smap) {
+                if (k % 10 == 0) {
+                    bhm_sharded_set(w->smap, word, len, (void *) 0x1234);
+                } else {
+                    bhm_sharded_get(w->smap, word, len);
+                }
+            } else {
+                pthread_mutex_lock(w->map_lock);
+                if (k % 10 == 0) {
+                    bhm_set(w->map, word, len, (void *) 0x1234);
+                } else {
+                    bhm_get(w->map, word, len);
+                }
+                pthread_mutex_unlock(w->map_lock);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+int concurrent_scaling(size_t iterations, const char *path) {
+    const long max_threads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+
+    fprintf(
+        stderr,
+        "Benchmark: 90%% get / 10%% set over all %d words from 1 to %ld threads\n"
+        "PASSES PER THREAD: %lu\n"
+        "WORDS.TXT path: %s\n"
+        "------------------\n",
+        WORDS_COUNT,
+        max_threads,
+        iterations,
+        path
+    );
+
+    struct wordpair {
+        char word[MAXWORDLEN];
+        size_t len;
+    };
+
+    /* load all the words into memory */
+    FILE *words_file = fopen(path, "r");
+    if (!words_file) {
+        return EXIT_FAILURE;
+    }
+
+    struct wordpair *words = malloc(WORDS_COUNT * sizeof(struct wordpair));
+    pthread_t *threads = malloc(max_threads * sizeof(pthread_t));
+    struct concurrent_worker *workers = malloc(max_threads * sizeof(struct concurrent_worker));
+    if (!words || !threads || !workers) {
+        free(words);
+        free(threads);
+        free(workers);
+        fclose(words_file);
+        return EXIT_FAILURE;
+    }
+
+    size_t i = 0;
+    while (fgets(words[i].word, MAXWORDLEN, words_file)) {
+        words[i].len = strlen(words[i].word);
+        i += 1;
+    }
+
+    fclose(words_file);
+    /* ---------------------------------------- */
+
+    fprintf(stderr, "%-8s %-22s %-22s %-22s\n", "THREADS", "CONCURRENT (Mops/s)", "SHARDED (Mops/s)", "GLOBAL MUTEX (Mops/s)");
+
+    for (long thread_count = 1; thread_count <= max_threads; thread_count++) {
+        double mops[3];
+
+        for (int variant = 0; variant < 3; variant++) {
+            BHashMapConcurrent *cmap = variant == 0 ? bhm_concurrent_create(0, &hashmap_config) : NULL;
+            BHashMapSharded *smap = variant == 1 ? bhm_sharded_create(0, 0, &hashmap_config) : NULL;
+            BHashMap *map = variant == 2 ? bhm_create(0, &hashmap_config) : NULL;
+            pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+            for (size_t j = 0; j < WORDS_COUNT; j++) {
+                if (cmap) {
+                    bhm_concurrent_set(cmap, words[j].word, words[j].len, (void *) 0x1234);
+                } else if (smap) {
+                    bhm_sharded_set(smap, words[j].word, words[j].len, (void *) 0x1234);
+                } else {
+                    bhm_set(map, words[j].word, words[j].len, (void *) 0x1234);
+                }
+            }
+
+            struct timespec time_start, time_end;
+            TIMER_GET(&time_start);
+
+            for (long t = 0; t < thread_count; t++) {
+                workers[t] = (struct concurrent_worker) {
+                    .words = words,
+                    .word_size = sizeof(struct wordpair),
+                    .len_offset = offsetof(struct wordpair, len),
+                    .passes = iterations,
+                    .offset = WORDS_COUNT / thread_count * t,
+                    .cmap = cmap,
+                    .smap = smap,
+                    .map = map,
+                    .map_lock = &map_lock
+                };
+
+                pthread_create(&threads[t], NULL, concurrent_worker_run, &workers[t]);
+            }
+
+            for (long t = 0; t < thread_count; t++) {
+                pthread_join(threads[t], NULL);
+            }
+
+            TIMER_GET(&time_end);
+
+            mops[variant] = (double) (thread_count * iterations * WORDS_COUNT) / (TIMER_DIFF(time_start, time_end) / 1000.0);
+
+            if (cmap) {
+                bhm_concurrent_destroy(cmap);
+            } else if (smap) {
+                bhm_sharded_destroy(smap);
+            } else {
+                bhm_destroy(map);
+            }
+        }
+
+        fprintf(stderr, "%-8ld %-22.2lf %-22.2lf %-22.2lf\n", thread_count, mops[0], mops[1], mops[2]);
+    }
+
+    free(workers);
+    free(threads);
+    free(words);
+    return EXIT_SUCCESS;
+}
+
+#define ITERATE_SHARDS 4
+
+struct iterate_shard {
+    const BHashMap *map;
+    size_t shard_idx;
+    size_t key_bytes;
+};
+
+static bool
+sum_keylen(const void *key, const size_t keylen, void *value, void *ctx) {
+    (void) key;
+    (void) value;
+    *(size_t *) ctx += keylen;
+    return true;
+}
+
+static void *
+iterate_shard_run(void *arg) {
+    struct iterate_shard *shard = arg;
+    bhm_iterate_range(shard->map, shard->shard_idx, ITERATE_SHARDS, sum_keylen, &shard->key_bytes);
+    return NULL;
+}
+
+/*
+Visit every pair of a full map and of the same map after removing 90% of its keys: with the cursor
+API, and split into ITERATE_SHARDS shards scanned by as many threads.
+*/
+int iterate_all(size_t iterations, const char *path) {
+    fprintf(
+        stderr,
+        "Benchmark: Iterate over all pairs of a map of all %d words\n"
+        "ITERATIONS: %lu\n"
+        "WORDS.TXT path: %s\n"
+        "------------------\n",
+        WORDS_COUNT,
+        iterations,
+        path
+    );
+
+    struct wordpair {
+        char word[MAXWORDLEN];
+        size_t len;
+    };
+
+    /* load all the words into memory and insert them into the hashmap as keys */
+    FILE *words_file = fopen(path, "r");
+    if (!words_file) {
+        return EXIT_FAILURE;
+    }
+
+    struct wordpair *words = malloc(WORDS_COUNT * sizeof(struct wordpair));
+    if (!words) {
+        fclose(words_file);
+        return EXIT_FAILURE;
+    }
+
+    size_t i = 0;
+    while (fgets(words[i].word, MAXWORDLEN, words_file)) {
+        words[i].len = strlen(words[i].word);
+        i += 1;
+    }
+
+    fclose(words_file);
+
+    BHashMap *map = bhm_create(0, &hashmap_config);
+    if (!map) {
+        free(words);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t j = 0; j < WORDS_COUNT; j++) {
+        bhm_set(map, words[j].word, words[j].len, (void *) 0x1234);
+    }
+    /* ---------------------------------------- */
+
+    fprintf(stderr, "%-10s %-14s %-18s\n", "PAIRS", "CURSOR (ms)", "SHARDED x4 (ms)");
+
+    for (int sparse = 0; sparse < 2; sparse++) {
+        if (sparse) {
+            for (size_t j = 0; j < WORDS_COUNT; j++) {
+                if (j % 10 != 0) {
+                    bhm_remove(map, words[j].word, words[j].len);
+                }
+            }
+        }
+
+        struct timespec time_start, time_end;
+        size_t ns_cursor = 0,
+               ns_sharded = 0,
+               key_bytes = 0;
+
+        for (size_t it = 0; it < iterations; it++) {
+            BHashMapIterator iter;
+            const void *key;
+            size_t keylen;
+            void *value;
+
+            TIMER_GET(&time_start);
+            bhm_iter_begin(map, &iter);
+            while (bhm_iter_next(&iter, &key, &keylen, &value)) {
+                key_bytes += keylen;
+            }
+            TIMER_GET(&time_end);
+            ns_cursor += TIMER_DIFF(time_start, time_end);
+
+            pthread_t threads[ITERATE_SHARDS];
+            struct iterate_shard shards[ITERATE_SHARDS];
+
+            TIMER_GET(&time_start);
+            for (size_t t = 0; t < ITERATE_SHARDS; t++) {
+                shards[t] = (struct iterate_shard) { .map = map, .shard_idx = t };
+                pthread_create(&threads[t], NULL, iterate_shard_run, &shards[t]);
+            }
+
+            for (size_t t = 0; t < ITERATE_SHARDS; t++) {
+                pthread_join(threads[t], NULL);
+                key_bytes -= shards[t].key_bytes;
+            }
+            TIMER_GET(&time_end);
+            ns_sharded += TIMER_DIFF(time_start, time_end);
+        }
+
+        /* both ways of iterating must see the same keys */
+        if (key_bytes != 0) {
+            bhm_destroy(map);
+            free(words);
+            return EXIT_FAILURE;
+        }
+
+        fprintf(stderr, "%-10lu %-14.3lf %-18.3lf\n", bhm_count(map), ns_cursor / iterations / 1e6, ns_sharded / iterations / 1e6);
+    }
+
+    bhm_destroy(map);
+    free(words);
+
+    return EXIT_SUCCESS;
+}
+
+/* usage: ./prog <type> <words.txt_file_path> [<iterations>] [<max_load_factor>] [<resize_growth_factor>] [chaining|open|dense] [arena|malloc] [<incremental_resize_step>] [auto|pow2|fastrange|modulo] [copy|borrow] */
 int main(int argc, char **argv) {
     size_t iterations = argc >= 4 ? atoll(argv[3]) : DEFAULT_ITER_COUNT;
 
@@ -238,24 +860,74 @@ int main(int argc, char **argv) {
     hashmap_config = (BHashMapConfig) {
         .max_load_factor = argc >= 5 ? atof(argv[4]) : 0,
         .resize_growth_factor = argc >= 6 ? atoll(argv[5]) : 0,
-        .hashfunc = NULL
+        .hashfunc = NULL,
+        .backend = BHM_BACKEND_CHAINING
     };
 
+    if (argc >= 7) {
+        if (strcmp(argv[6], "open") == 0) {
+            hashmap_config.backend = BHM_BACKEND_OPEN_ADDRESSING;
+        } else if (strcmp(argv[6], "dense") == 0) {
+            hashmap_config.backend = BHM_BACKEND_DENSE;
+        }
+    }
+
+    hashmap_config.incremental_resize_step = argc >= 9 ? atoll(argv[8]) : 0;
+
+    if (argc >= 10) {
+        if (strcmp(argv[9], "pow2") == 0) {
+            hashmap_config.indexing = BHM_INDEXING_POW2;
+        } else if (strcmp(argv[9], "fastrange") == 0) {
+            hashmap_config.indexing = BHM_INDEXING_FASTRANGE;
+        } else if (strcmp(argv[9], "modulo") == 0) {
+            hashmap_config.indexing = BHM_INDEXING_MODULO;
+        }
+    }
+
+    if (argc >= 8 && strcmp(argv[7], "malloc") == 0) {
+        hashmap_config.allocator = (BHashMapAllocator) {
+            .allocate = malloc_allocate,
+            .deallocate = malloc_deallocate
+        };
+    }
+
+    hashmap_config.borrow_keys = argc >= 11 && strcmp(argv[10], "borrow") == 0;
+
     fprintf(
         stderr,
         "HASHMAP CONFIGURATION:\n"
         "\tMAX. LOAD FACTOR: %.3lf\n"
         "\tRESIZE GROWTH FACTOR: %lu\n"
+        "\tBACKEND: %s\n"
+        "\tALLOCATOR: %s\n"
+        "\tINCREMENTAL RESIZE STEP: %lu\n"
+        "\tINDEXING: %s\n"
+        "\tKEYS: %s\n"
         "---------------------------\n",
         hashmap_config.max_load_factor,
-        hashmap_config.resize_growth_factor
+        hashmap_config.resize_growth_factor,
+        argc >= 7 ? argv[6] : "chaining",
+        hashmap_config.allocator.allocate ? "malloc" : "arena",
+        hashmap_config.incremental_resize_step,
+        argc >= 10 ? argv[9] : "auto",
+        hashmap_config.borrow_keys ? "borrowed" : "copied"
     );
 
     if (strcmp(argv[1], "access") == 0) {
         return access_all(iterations, argv[2]);
+    } else if (strcmp(argv[1], "access_batch") == 0) {
+        return access_batch(iterations, argv[2]);
     } else if (strcmp(argv[1], "insert") == 0) {
         return insert_all(iterations, argv[2]);
+    } else if (strcmp(argv[1], "concurrent") == 0) {
+        return concurrent_scaling(iterations, argv[2]);
+    } else if (strcmp(argv[1], "insert_latency") == 0) {
+        return insert_latency(iterations, argv[2]);
     } else if (strcmp(argv[1], "insert_create_destroy") == 0) {
         return insert_all_create_destroy(iterations, argv[2]);
+    } else if (strcmp(argv[1], "build") == 0) {
+        return build_all(iterations, argv[2]);
+    } else if (strcmp(argv[1], "iterate") == 0) {
+        return iterate_all(iterations, argv[2]);
     } else return EXIT_FAILURE;
 }
@@ -1,18 +1,47 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "bhashmap.h"
-#include "murmurhash3.h"
+#include "hashing.h"
+#include "bhashmap_ctrl_group.h"
+#include "arena.h"
+#include "snapshot.h"
 #include "benchmark.h"
+#include "histogram.h"
 
 #define BHM_DEFAULT_INITIAL_CAPCACITY 32
 #define BHM_DEFAULT_MAX_LOAD_FACTOR 0.75
+#define BHM_DEFAULT_OPEN_MAX_LOAD_FACTOR 0.875
+#define BHM_OPEN_LOAD_FACTOR_LIMIT 0.9375
 #define BHM_DEFAULT_RESIZE_GROWTH_FACTOR 2
 
+/*
+A chain this long is all but impossible with a random seed at the default load factor, so finding
+one on insert means the keys were picked to collide (see chain_reseed). The default grows with
+the maximum load factor of the map.
+*/
+#define BHM_DEFAULT_MAX_CHAIN_LENGTH 16
+
+#define SLOT_NONE SIZE_MAX
+
+/* the key length that marks an entry of a dense map as removed */
+#define DENSE_ENTRY_REMOVED SIZE_MAX
+
+/* number of keys of a batch operation that are hashed and prefetched ahead of being looked up */
+#define BHM_BATCH_CHUNK 16
+
+/* bhm_build only spreads its work over more threads if each of them gets at least this many keys */
+#define BHM_BUILD_MIN_KEYS_PER_THREAD (64 * 1024)
+#define BHM_BUILD_MAX_THREADS 64
+
 /*
 The DEBUG_PRINT macro only expands if BHM_DEBUG is defined. Otherwise, it expands to nothing
 and as such no print is performed.
@@ -24,57 +53,349 @@ and as such no print is performed.
 #define DEBUG_PRINT(fmt, ...)
 #endif
 
+/*
+A pair of the chained table. The key is stored in the same allocation, right after the value (see
+pair_key_bytes), which with inline values takes up more than the "value" member itself.
+*/
 typedef struct HashPair {
     size_t keylen;
-    const void *value;
     struct HashPair *next;
-    unsigned char key[];
+    uint64_t hash;
+    const void *value;
 } HashPair;
 
+/*
+Keys of up to this many bytes are stored in the slot itself rather than in a heap copy. Lookups
+of such keys, which include all integer keys and most words of natural language, never leave
+the slot array.
+*/
+#define SLOT_INLINE_KEY_MAX 16
+
+/*
+A slot of the open-addressed table. Slots are stored by value in one flat array, parallel to
+the array of control bytes. Keys of up to SLOT_INLINE_KEY_MAX bytes are stored in the slot
+itself; longer keys are a heap copy, as with HashPair, or with borrowed keys a pointer to the
+caller's memory.
+
+Both HashPair and Slot cache the full hash of their key: it is compared before the key itself,
+and it is all a rehash needs to place the entry in the new table.
+
+The value comes last, so that inline values (see value_size) can extend past the end of the
+struct: slots are then map->slot_size bytes apart rather than sizeof(Slot) (see slot_at).
+*/
+typedef struct Slot {
+    uint64_t hash;
+    size_t keylen;
+    union {
+        const unsigned char *ptr;
+        unsigned char bytes[SLOT_INLINE_KEY_MAX];
+    } key;
+    const void *value;
+} Slot;
+
 struct BHashMap {
     BHashMapConfig config;
 
+    /* number of buckets (chaining) or slots (open addressing) */
     size_t capacity,
            pair_count;
 
+    /*
+    The loads at which the table grows (max_load_factor * capacity) and shrinks (min_load_factor *
+    capacity), kept up to date with capacity.
+    */
+    size_t resize_threshold,
+           shrink_threshold;
+
+    /*
+    Bytes taken up by the value of a pair or slot, starting at its "value" member: the size of a
+    pointer, or with inline values, value_size rounded up to a multiple of it. "slot_size" is the
+    size of a slot (or dense entry) including its value.
+    */
+    size_t value_bytes,
+           slot_size;
+
+    /*
+    Number of times the hash function has been reseeded, and the number of pairs the map has to
+    reach before it may be reseeded again (see chain_reseed).
+    */
+    size_t reseed_count,
+           reseed_min_count;
+
+    /*
+    Set once the caller may hold on to hashes computed with the current seed (see pin_seed).
+    Atomic because it is set from lookups, which may run concurrently.
+    */
+    atomic_bool seed_pinned;
+
+    /* rebuilds of the table and the time they took in total, for bhm_get_stats */
+    size_t resize_count;
+    uint64_t resize_ns;
+
+    /* operation counters (see bhm_enable_counters) */
+    bool counters_enabled;
+    uint64_t operation_count,
+             hit_count,
+             miss_count,
+             probe_count;
+
+    /* BHM_BACKEND_CHAINING */
     HashPair **buckets;
 
-    #ifdef BHM_DEBUG_BENCHMARK
-    struct _debugBenchmarkTimes {
-        size_t bhm_resize_total_ms,
-               bhm_set_total_ms,
-               bhm_get_total_ms;
-    } debug_benchmark_times;
-    #endif
+    /*
+    Incremental resizing: while a resize is in progress, "buckets_old" holds the previous bucket
+    array. Its buckets below "migrate_idx" have already been moved to "buckets".
+    */
+    HashPair **buckets_old;
+    size_t capacity_old,
+           migrate_idx;
+
+    /* BHM_BACKEND_OPEN_ADDRESSING (and the index of BHM_BACKEND_DENSE) */
+    int8_t *ctrl;
+    Slot *slots;
+    size_t tombstone_count;
+
+    /*
+    BHM_BACKEND_DENSE: the pairs are entries of "entries", in insertion order, including removed
+    entries that haven't been compacted away yet. The index is an open-addressed table like that
+    of BHM_BACKEND_OPEN_ADDRESSING, with "ctrl" and "capacity", whose slots hold only the position
+    of an entry.
+    */
+    Slot *entries;
+    uint32_t *indices;
+    size_t entry_count,
+           entry_capacity;
+
+    /* BHM_BACKEND_SNAPSHOT */
+    Snapshot snapshot;
+
+    /* backs pairs and key copies unless the config supplies an allocator */
+    Arena arena;
+
+    /*
+    Latency histograms, one per BHashMapOperation, allocated while latency recording is enabled
+    (see bhm_enable_latency). One in every "latency_sample_interval" operations is timed; the
+    countdown runs to the next one.
+    */
+    Histogram *latency;
+    size_t latency_sample_interval,
+           latency_countdown;
 };
 
-static uint32_t
-murmur3_32_wrapper(const void *data, size_t len) {
-    return murmur3_32(data, len, 1u);
-}
-
+/* the hash function fields are filled in by hashing_resolve_config */
 static const BHashMapConfig DEFAULT_HASHMAP_CONFIG = (BHashMapConfig) {
-    .hashfunc = murmur3_32_wrapper,
     .max_load_factor = BHM_DEFAULT_MAX_LOAD_FACTOR ,
-    .resize_growth_factor = BHM_DEFAULT_RESIZE_GROWTH_FACTOR
+    .resize_growth_factor = BHM_DEFAULT_RESIZE_GROWTH_FACTOR,
+    .indexing = BHM_INDEXING_POW2
 };
 
 static void
-free_buckets(HashPair **buckets, const size_t bucket_count);
+free_buckets(BHashMap *map, HashPair **buckets, const size_t bucket_count);
 
 static inline HashPair *
-create_pair(const size_t keylen); 
+create_pair(BHashMap *map, const size_t keylen, const uint64_t hash); 
+
+static bool
+dense_rebuild(BHashMap *map, const size_t capacity_new);
+
+/*
+Allocate memory for a pair or a key copy, from the user-supplied allocator if there is one and
+from the arena of the map otherwise.
+*/
+static inline void *
+map_alloc(BHashMap *map, const size_t size) {
+    if (map->config.allocator.allocate) {
+        return map->config.allocator.allocate(map->config.allocator.ctx, size);
+    }
+
+    return arena_alloc(&map->arena, size);
+}
+
+/*
+Free memory obtained from map_alloc. "size" must be the size it was allocated with.
+*/
+static inline void
+map_free(BHashMap *map, void *ptr, const size_t size) {
+    if (map->config.allocator.allocate) {
+        map->config.allocator.deallocate(map->config.allocator.ctx, ptr, size);
+        return;
+    }
+
+    arena_free(&map->arena, ptr, size);
+}
+
+/*
+Return the value of a pair or slot, given its "value" member: the pointer stored in it, or with
+inline values, the address of the value bytes themselves.
+*/
+static inline void *
+value_get(const BHashMap *map, const void *const *value) {
+    return map->config.value_size > 0 ? (void *) value : (void *) *value;
+}
+
+/*
+Store "data" as the value of a pair or slot: the pointer itself, or with inline values, the
+value_size bytes it points to (or zeroes if it is NULL).
+*/
+static inline void
+value_set(const BHashMap *map, const void **value, const void *data) {
+    if (map->config.value_size == 0) {
+        *value = data;
+    } else if (data) {
+        memmove((void *) value, data, map->config.value_size);
+    } else {
+        memset((void *) value, 0, map->config.value_size);
+    }
+}
+
+/* slot "idx" of an array of slots or dense entries, which are map->slot_size bytes apart */
+static inline Slot *
+slot_at(const BHashMap *map, const Slot *slots, const size_t idx) {
+    return (Slot *) ((const unsigned char *) slots + idx * map->slot_size);
+}
 
 static inline double
 get_load_factor(const BHashMap *map) {
     return (double) map->pair_count / (double) map->capacity;
 }
 
+/* the smallest load of a table of "capacity" for which load / capacity >= max_load_factor */
+static inline size_t
+load_threshold(const BHashMap *map, const size_t capacity) {
+    const double threshold = map->config.max_load_factor * (double) capacity;
+
+    return (size_t) threshold + ((double) (size_t) threshold < threshold);
+}
+
+/*
+Recompute the load at which the table grows, after its capacity has changed, so that inserts only
+compare two integers.
+*/
+static inline void
+update_resize_threshold(BHashMap *map) {
+    map->resize_threshold = load_threshold(map, map->capacity);
+    map->shrink_threshold = (size_t) (map->config.min_load_factor * (double) map->capacity);
+}
+
+/* account for a rebuild of the table that started at "bench_start_nanos" (see start_benchmark) */
+static inline void
+count_rebuild(BHashMap *map, const uint64_t bench_start_nanos) {
+    const uint64_t elapsed_ns = end_benchmark(bench_start_nanos);
+
+    map->resize_count += 1;
+    map->resize_ns += elapsed_ns;
+
+    /* rebuilds are rare enough to be recorded without sampling */
+    if (map->latency) {
+        histogram_record(&map->latency[BHM_OPERATION_RESIZE], elapsed_ns);
+    }
+}
+
+/*
+Return the start time of an operation if its latency is to be recorded, or 0 if it isn't: latency
+recording is disabled, or the operation isn't sampled.
+*/
+static inline uint64_t
+latency_start(BHashMap *map) {
+    if (!map->latency || --map->latency_countdown > 0) {
+        return 0;
+    }
+
+    map->latency_countdown = map->latency_sample_interval;
+
+    return start_benchmark();
+}
+
+/* record the latency of an operation for which latency_start returned "start_nanos" */
+static inline void
+latency_end(BHashMap *map, const BHashMapOperation operation, const uint64_t start_nanos) {
+    if (start_nanos) {
+        histogram_record(&map->latency[operation], end_benchmark(start_nanos));
+    }
+}
+
+static inline bool
+is_power_of_two(const size_t n) {
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+/*
+Map a hash onto a bucket index in [0, capacity), according to the indexing mode of the map.
+
+BHM_INDEXING_POW2 requires a power-of-two capacity and keeps the low bits of the hash, so the
+hash is run through a finalizer first: otherwise a hash function with weak low bits (e.g. one
+that returns integer keys as they are) would put every key with the same low bits in the same
+bucket. BHM_INDEXING_FASTRANGE takes the high bits of hash * capacity, which spreads the hash
+over any capacity with a single multiplication. Both avoid the integer division of
+BHM_INDEXING_MODULO.
+*/
+static inline size_t
+bucket_index(const BHashMapIndexing indexing, const uint64_t hash, const size_t capacity) {
+    switch (indexing) {
+        case BHM_INDEXING_POW2: {
+            uint64_t h = hash;
+            h ^= h >> 32;
+            h *= 0xd6e8feb86659fd93ull;
+            h ^= h >> 32;
+            return h & (capacity - 1);
+        }
+        case BHM_INDEXING_FASTRANGE:
+            return (size_t) (((__uint128_t) hash * capacity) >> 64);
+        default:
+            return hash % capacity;
+    }
+}
+
+/*
+Round a bucket count up to what the indexing mode of the map supports.
+*/
+static inline size_t
+chain_round_capacity(const BHashMap *map, const size_t capacity) {
+    if (map->config.indexing != BHM_INDEXING_POW2) {
+        return capacity;
+    }
+
+    size_t rounded = 1;
+
+    while (rounded < capacity) {
+        rounded *= 2;
+    }
+
+    return rounded;
+}
+
 /*
 Calculate and print various statistics to specified stream.
 */
 void
 bhm_print_debug_stats(const BHashMap *map, FILE *stream) {
+    if (map->config.backend != BHM_BACKEND_CHAINING) {
+        const int8_t *ctrl = map->config.backend == BHM_BACKEND_SNAPSHOT ? map->snapshot.ctrl : map->ctrl;
+        size_t empty_slot_count = 0;
+
+        for (size_t i = 0; i < map->capacity; i++) {
+            if (ctrl[i] == BHM_CTRL_EMPTY) {
+                empty_slot_count += 1;
+            }
+        }
+
+        if (map->config.backend == BHM_BACKEND_SNAPSHOT) {
+            fprintf(stream, "\e[1;93msnapshot (bytes): %lu\n", map->snapshot.size);
+        }
+
+        if (map->config.backend == BHM_BACKEND_DENSE) {
+            fprintf(stream, "\e[1;93mentries (used/allocated): %lu/%lu\n", map->entry_count, map->entry_capacity);
+            fprintf(stream, "\e[1;93mremoved entries: %lu\n", map->entry_count - map->pair_count);
+        }
+
+        fprintf(stream, "\e[1;93mcapacity (slots): %lu\n", map->capacity);
+        fprintf(stream, "\e[1;93mitems (pairs): %lu\n", map->pair_count);
+        fprintf(stream, "\e[1;93mempty slots: %lu\n", empty_slot_count);
+        fprintf(stream, "\e[1;93mdeleted slots: %lu\n", map->tombstone_count);
+        fprintf(stream, "\e[1;93mload factor: %.3lf\n", get_load_factor(map));
+        return;
+    }
+
     size_t empty_bucket_count = 0,
            overflow_bucket_count = 0; // buckets with more than one element in ll
 
@@ -94,8 +415,64 @@ bhm_print_debug_stats(const BHashMap *map, FILE *stream) {
     fprintf(stream, "\e[1;93mempty buckets: %lu\n", empty_bucket_count);
     fprintf(stream, "\e[1;93moverflown buckets: %lu\n", overflow_bucket_count);
     fprintf(stream, "\e[1;93mload factor: %.3lf\n", get_load_factor(map));
+    fprintf(stream, "\e[1;93mreseeds: %lu\n", map->reseed_count);
+
+    if (map->buckets_old) {
+        fprintf(stream, "\e[1;93mresize in progress: %lu/%lu buckets migrated\n", map->migrate_idx, map->capacity_old);
+    }
+}
+
+static inline const unsigned char *
+slot_key(const Slot *slot) {
+    return slot->keylen <= SLOT_INLINE_KEY_MAX ? slot->key.bytes : slot->key.ptr;
+}
+
+/* free the heap copy of the key of a slot, if it has one */
+static inline void
+slot_free_key(BHashMap *map, const Slot *slot) {
+    if (slot->keylen > SLOT_INLINE_KEY_MAX && !map->config.borrow_keys) {
+        map_free(map, (void *) slot->key.ptr, slot->keylen);
+    }
+}
+
+/*
+Round a requested slot count up to the capacity of an open-addressed table: a power of two
+number of whole control byte groups.
+*/
+static inline size_t
+open_round_capacity(const size_t capacity) {
+    size_t rounded = BHM_CTRL_GROUP_WIDTH;
+
+    while (rounded < capacity) {
+        rounded *= 2;
+    }
+
+    return rounded;
 }
 
+/*
+Allocate the control byte and slot arrays of an open-addressed table with "capacity" slots,
+with every slot marked empty.
+RETURN VALUE:
+    On success, true is returned.
+    On failure, false is returned and nothing is allocated.
+*/
+static bool
+open_alloc_table(const BHashMap *map, const size_t capacity, int8_t **ctrl, Slot **slots) {
+    /* the control bytes are loaded a whole group at a time, so they must be group-aligned */
+    *ctrl = aligned_alloc(BHM_CTRL_GROUP_WIDTH, capacity);
+    *slots = malloc(capacity * map->slot_size);
+
+    if (!(*ctrl) || !(*slots)) {
+        free(*ctrl);
+        free(*slots);
+        return false;
+    }
+
+    memset(*ctrl, BHM_CTRL_EMPTY, capacity);
+
+    return true;
+}
 
 /*
 Create a new BHashMap with a given initial capacity.
@@ -107,86 +484,282 @@ BHashMap *
 bhm_create(const size_t initial_capacity, const BHashMapConfig *config_user) {
     BHashMap *new_map = malloc(sizeof(BHashMap));
 
-    if (!new_map) {
+    /* snapshot-backed maps are only created by bhm_open_mmap */
+    if (!new_map || (config_user && config_user->backend == BHM_BACKEND_SNAPSHOT)) {
+        free(new_map);
         return NULL;
     }
 
-    const size_t capacity = initial_capacity != 0 ? initial_capacity : BHM_DEFAULT_INITIAL_CAPCACITY;
+    size_t capacity = initial_capacity != 0 ? initial_capacity : BHM_DEFAULT_INITIAL_CAPCACITY;
 
     *new_map = (BHashMap) {
         .capacity = capacity,
-        .pair_count = 0,
-        .buckets = calloc(capacity, sizeof(HashPair *)),
-        #ifdef BHM_DEBUG_BENCHMARK
-        .debug_benchmark_times = (struct _debugBenchmarkTimes) {
-            0, 0, 0
-        }
-        #endif
+        .pair_count = 0
     };
 
+    atomic_init(&new_map->seed_pinned, false);
+
     if (config_user == NULL) {
         new_map->config = DEFAULT_HASHMAP_CONFIG;
+        hashing_resolve_config(&new_map->config, NULL);
     } else {
+        const double default_load_factor = config_user->backend == BHM_BACKEND_CHAINING
+                                         ? BHM_DEFAULT_MAX_LOAD_FACTOR
+                                         : BHM_DEFAULT_OPEN_MAX_LOAD_FACTOR;
+
         new_map->config = (BHashMapConfig) {
-            .hashfunc = config_user->hashfunc != NULL ? config_user->hashfunc : murmur3_32_wrapper,
-            .max_load_factor = config_user->max_load_factor > 0 ? config_user->max_load_factor : BHM_DEFAULT_MAX_LOAD_FACTOR,
-            .resize_growth_factor = config_user->resize_growth_factor > 0 ? config_user->resize_growth_factor : BHM_DEFAULT_RESIZE_GROWTH_FACTOR
+            .max_load_factor = config_user->max_load_factor > 0 ? config_user->max_load_factor : default_load_factor,
+            .resize_growth_factor = config_user->resize_growth_factor > 0 ? config_user->resize_growth_factor : BHM_DEFAULT_RESIZE_GROWTH_FACTOR,
+            .backend = config_user->backend,
+            /* the open-addressed table is always rehashed in one go */
+            .incremental_resize_step = config_user->backend == BHM_BACKEND_CHAINING ? config_user->incremental_resize_step : 0,
+            /* a custom allocator is only usable if it can both allocate and free */
+            .allocator = config_user->allocator.allocate != NULL && config_user->allocator.deallocate != NULL
+                       ? config_user->allocator
+                       : (BHashMapAllocator) { 0 },
+            .indexing = config_user->indexing,
+            .borrow_keys = config_user->borrow_keys,
+            .min_load_factor = config_user->min_load_factor > 0 ? config_user->min_load_factor : 0,
+            .max_chain_length = config_user->max_chain_length,
+            .value_size = config_user->value_size
         };
+
+        /*
+        Power-of-two capacities are kept power-of-two by a power-of-two growth factor, so masking is
+        preferred when the growth factor allows it. Otherwise capacities would have to be rounded up
+        on every resize, and fastrange is used instead.
+        */
+        if (new_map->config.indexing == BHM_INDEXING_AUTO) {
+            new_map->config.indexing = is_power_of_two(new_map->config.resize_growth_factor)
+                                     ? BHM_INDEXING_POW2
+                                     : BHM_INDEXING_FASTRANGE;
+        }
+
+        hashing_resolve_config(&new_map->config, config_user);
     }
 
-    if (!new_map->buckets) {
-        free(new_map);
-        return NULL;
+    arena_init(&new_map->arena);
+
+    if (new_map->config.backend != BHM_BACKEND_CHAINING) {
+        /* a probe for a missing key only terminates at an empty slot, so the table may never fill up */
+        if (new_map->config.max_load_factor > BHM_OPEN_LOAD_FACTOR_LIMIT) {
+            new_map->config.max_load_factor = BHM_OPEN_LOAD_FACTOR_LIMIT;
+        }
+
+        /* the open-addressed table always has a power-of-two number of slots and masks the hash */
+        new_map->config.indexing = BHM_INDEXING_POW2;
+    }
+
+    /*
+    A shrink leaves the table between a quarter and half of its maximum load (see shrink), so a
+    higher minimum load could have it shrink again right away.
+    */
+    if (new_map->config.min_load_factor > new_map->config.max_load_factor / 4) {
+        new_map->config.min_load_factor = new_map->config.max_load_factor / 4;
+    }
+
+    if (new_map->config.max_chain_length == 0) {
+        const double load_scale = new_map->config.max_load_factor > 1 ? new_map->config.max_load_factor : 1;
+
+        new_map->config.max_chain_length = (size_t) (BHM_DEFAULT_MAX_CHAIN_LENGTH * load_scale);
+    }
+
+    new_map->value_bytes = sizeof(void *);
+
+    while (new_map->value_bytes < new_map->config.value_size) {
+        new_map->value_bytes += sizeof(void *);
+    }
+
+    new_map->slot_size = offsetof(Slot, value) + new_map->value_bytes;
+
+    if (new_map->config.backend == BHM_BACKEND_OPEN_ADDRESSING) {
+        new_map->capacity = open_round_capacity(capacity);
+
+        if (!open_alloc_table(new_map, new_map->capacity, &new_map->ctrl, &new_map->slots)) {
+            free(new_map);
+            return NULL;
+        }
+    } else if (new_map->config.backend == BHM_BACKEND_DENSE) {
+        if (!dense_rebuild(new_map, open_round_capacity(capacity))) {
+            free(new_map);
+            return NULL;
+        }
+    } else {
+        new_map->capacity = chain_round_capacity(new_map, capacity);
+        new_map->buckets = calloc(new_map->capacity, sizeof(HashPair *));
+
+        if (!new_map->buckets) {
+            free(new_map);
+            return NULL;
+        }
     }
 
-    DEBUG_PRINT("\e[93;1mbhm_create\e[0m: created hash map with capacity %lu.\n", initial_capacity);
+    update_resize_threshold(new_map);
+
+    DEBUG_PRINT("\e[93;1mbhm_create\e[0m: created hash map with capacity %lu.\n", new_map->capacity);
 
     return new_map;
 }
 
 /*
-Find and return the appropriate bucket for a given key,
-based on its hash and the capacity of the hashmap.
+Find and return the appropriate bucket for a given key hash,
+based on the capacity of the hashmap.
 */
 static inline HashPair **
-find_bucket(const BHashMap *map, const void *key, const size_t keylen) {
-    const uint32_t hash       = map->config.hashfunc(key, keylen),
-                   bucket_idx = hash % map->capacity;
+find_bucket(const BHashMap *map, const uint64_t hash) {
+    const size_t bucket_idx = bucket_index(map->config.indexing, hash, map->capacity);
 
-    DEBUG_PRINT("KEY: '%s', BUCKET IDX: %u\n", (char *) key, bucket_idx);
+    DEBUG_PRINT("HASH: %016lx, BUCKET IDX: %lu\n", hash, bucket_idx);
 
     return &map->buckets[bucket_idx];
 }
 
+/*
+Compare two keys of "keylen" bytes. Integer-sized keys are compared with a single load and
+compare each instead of a call to memcmp.
+*/
+static inline bool
+keys_equal(const void *a, const void *b, const size_t keylen) {
+    if (keylen == sizeof(uint64_t)) {
+        uint64_t x, y;
+        memcpy(&x, a, sizeof(x));
+        memcpy(&y, b, sizeof(y));
+        return x == y;
+    }
+
+    if (keylen == sizeof(uint32_t)) {
+        uint32_t x, y;
+        memcpy(&x, a, sizeof(x));
+        memcpy(&y, b, sizeof(y));
+        return x == y;
+    }
+
+    return memcmp(a, b, keylen) == 0;
+}
+
+/*
+Size of the allocation of a pair: the pair itself, its value and its key. With borrowed keys, the
+key of a pair is only a pointer to the caller's memory.
+*/
+static inline size_t
+pair_size(const BHashMap *map, const size_t keylen) {
+    return offsetof(HashPair, value) + map->value_bytes + (map->config.borrow_keys ? sizeof(const unsigned char *) : keylen);
+}
+
+/* the bytes of the allocation of a pair that hold its key (or with borrowed keys, the pointer to it) */
+static inline unsigned char *
+pair_key_bytes(const BHashMap *map, const HashPair *pair) {
+    return (unsigned char *) &pair->value + map->value_bytes;
+}
+
+static inline const unsigned char *
+pair_key(const BHashMap *map, const HashPair *pair) {
+    if (map->config.borrow_keys) {
+        const unsigned char *key;
+        memcpy(&key, pair_key_bytes(map, pair), sizeof(key));
+        return key;
+    }
+
+    return pair_key_bytes(map, pair);
+}
+
+/*
+Check whether a chained pair holds the given key. The cached hashes are compared first, so
+only a true match (or a full 64-bit hash collision) ever reaches the key comparison.
+*/
+static inline bool
+pair_matches(const BHashMap *map, const HashPair *pair, const uint64_t hash, const void *key, const size_t keylen) {
+    return pair->hash == hash && pair->keylen == keylen && keys_equal(key, pair_key(map, pair), keylen);
+}
+
 /*
 Insert a key-value pair into a HashPair structure.
 */
 static inline void
-insert_pair(HashPair *pair, const void *key, const size_t keylen, const void *data) {
-    memcpy(pair->key, key, keylen);
-    pair->value = data;
+insert_pair(const BHashMap *map, HashPair *pair, const void *key, const size_t keylen, const void *data) {
+    if (map->config.borrow_keys) {
+        memcpy(pair_key_bytes(map, pair), &key, sizeof(key));
+    } else {
+        memcpy(pair_key_bytes(map, pair), key, keylen);
+    }
+
+    value_set(map, &pair->value, data);
 }
 
 /* 
-Return a pointer to a new zeroed-out HashPair struct allocated on the heap, or NULL on failure.
+Return a pointer to a new zeroed-out HashPair struct allocated through the map's allocator, or NULL on failure.
 */
 static inline HashPair *
-create_pair(const size_t keylen) {
-    HashPair *new = malloc(sizeof(HashPair) + keylen);
+create_pair(BHashMap *map, const size_t keylen, const uint64_t hash) {
+    HashPair *new = map_alloc(map, pair_size(map, keylen));
     if (!new) {
         return NULL;
     }
 
     *new = (struct HashPair) {
         .keylen = keylen,
-        0
+        .hash = hash
     };
 
     return new;
 }
 
 /*
-Resize the given hash map by the constant resize factor.
+Prepend every pair of a chain to the chain of its bucket in the current bucket array of the map,
+placing it by its cached hash.
+*/
+static inline void
+move_chain(BHashMap *map, HashPair *head) {
+    while (head) {
+        HashPair **bucket_new = find_bucket(map, head->hash);
+
+        HashPair *n = head->next;
+        head->next = *bucket_new;
+        *bucket_new = head;
+
+        head = n;
+    }
+}
+
+/*
+Move up to "bucket_budget" buckets of an incremental resize in progress to the new bucket array,
+and free the old array once it has been fully migrated.
+*/
+static void
+migrate_buckets(BHashMap *map, size_t bucket_budget) {
+    while (bucket_budget > 0 && map->migrate_idx < map->capacity_old) {
+        move_chain(map, map->buckets_old[map->migrate_idx]);
+        map->buckets_old[map->migrate_idx] = NULL;
+
+        map->migrate_idx += 1;
+        bucket_budget -= 1;
+    }
+
+    if (map->migrate_idx == map->capacity_old) {
+        free(map->buckets_old);
+        map->buckets_old = NULL;
+        map->capacity_old = 0;
+        map->migrate_idx = 0;
+    }
+}
+
+/*
+Advance an incremental resize, if one is in progress, by the configured number of buckets.
+Called at the start of every operation on the map.
+*/
+static inline void
+migrate_step(BHashMap *map) {
+    if (map->buckets_old) {
+        migrate_buckets(map, map->config.incremental_resize_step);
+    }
+}
+
+/*
+Resize the bucket array of the given hash map to "capacity_new" buckets.
+
+With incremental resizing enabled, only the new bucket array is allocated here: the pairs are
+moved over a few buckets at a time by subsequent operations (see migrate_step). A resize that is
+still in progress is completed first.
 
 On failure, the hash map is not resized and remains just as it was before the call.
 
@@ -195,14 +768,13 @@ RETURN VALUE:
     On failure, false is returned.
 */
 static bool
-resize(BHashMap *map) {
-    #ifdef BHM_DEBUG_BENCHMARK
-    double start_load_factor = get_load_factor(map);
-    uint64_t bench_start_nanos = start_benchmark();
-    #endif
+chain_resize(BHashMap *map, const size_t capacity_new) {
+    if (map->buckets_old) {
+        migrate_buckets(map, SIZE_MAX);
+    }
 
-    size_t capacity_new = map->capacity * map->config.resize_growth_factor,
-           capacity_old = map->capacity;
+    const uint64_t bench_start_nanos = start_benchmark();
+    const size_t capacity_old = map->capacity;
 
     HashPair **buckets_new = calloc(capacity_new, sizeof(HashPair *)),
              **buckets_old = map->buckets;
@@ -214,238 +786,1974 @@ resize(BHashMap *map) {
 
     map->buckets = buckets_new;
     map->capacity = capacity_new;
+    update_resize_threshold(map);
 
-    /* rehash every key-value pair from the old table */
+    if (map->config.incremental_resize_step > 0) {
+        map->buckets_old = buckets_old;
+        map->capacity_old = capacity_old;
+        map->migrate_idx = 0;
+    } else {
+        /* move every key-value pair from the old table, placing it by its cached hash */
+        for (size_t idx_old = 0; idx_old < capacity_old; idx_old++) {
+            move_chain(map, buckets_old[idx_old]);
+        }
 
-    for (size_t idx_old = 0; idx_old < capacity_old; idx_old++) {
-        HashPair *head = buckets_old[idx_old];
+        free(buckets_old);
+    }
 
-        /* empty bucket slot */
-        if (head == NULL) {
-            continue;
-        }
+    count_rebuild(map, bench_start_nanos);
 
-        /* head bucket pair exists */
-        while (head) {
-            /* find new bucket position for this pair*/
-            HashPair **bucket_new = find_bucket(map, head->key, head->keylen);
+    DEBUG_PRINT("resized %lu -> %lu buckets\n", capacity_old, capacity_new);
 
-            /* dest bucket slot empty */
-            if (*bucket_new == NULL) {
-                *bucket_new = head;
+    return true;
+}
 
-                HashPair *n = head->next;
-                head->next = NULL;
-                head = n;
+/* grow the bucket array of the given hash map by the constant resize factor */
+static inline bool
+resize(BHashMap *map) {
+    return chain_resize(map, chain_round_capacity(map, map->capacity * map->config.resize_growth_factor));
+}
 
-                continue;
-            }
+/*
+Find the link (either a bucket head or the "next" member of a pair) that points to the pair
+holding the given key. While an incremental resize is in progress, the key's bucket in the old
+bucket array is searched as well, if it hasn't been migrated yet.
 
-            /* dest bucket slot filled, prepend current old head to beginning of chain*/
-            
-            HashPair *n = head->next;
-            head->next = *bucket_new;
-            *bucket_new = head;
+If "chain_length" is not NULL, it is set to the number of pairs of the current bucket array that
+were walked past.
 
-            head = n;
+RETURN VALUE:
+    If the key is in the map, the link pointing to its pair.
+    Otherwise, the NULL link that terminates the key's chain in the current bucket array,
+    i.e. the link a new pair for the key should be stored in.
+*/
+static inline HashPair **
+chain_find(const BHashMap *map, const uint64_t hash, const void *key, const size_t keylen, size_t *chain_length) {
+    if (map->buckets_old) {
+        const size_t idx_old = bucket_index(map->config.indexing, hash, map->capacity_old);
+
+        if (idx_old >= map->migrate_idx) {
+            for (HashPair **link = &map->buckets_old[idx_old]; *link; link = &(*link)->next) {
+                if (pair_matches(map, *link, hash, key, keylen)) {
+                    return link;
+                }
+            }
         }
     }
 
-    free(buckets_old);
+    HashPair **link = find_bucket(map, hash);
+    size_t length = 0;
 
-    #ifdef BHM_DEBUG_BENCHMARK
-    uint64_t time_elapsed = end_benchmark(bench_start_nanos);
-    double end_load_factor = get_load_factor(map);
-    fprintf(stderr, "\e[1;93mresize\e[0m \e[32m%6lu\e[0m -> \e[32m%7lu\e[0m, LF \e[32m%.3lf\e[0m -> \e[32m%.3lf\e[0m took %5lums.\n", capacity_old, capacity_new, start_load_factor, get_load_factor(map), time_elapsed);
-    map->debug_benchmark_times.bhm_resize_total_ms += time_elapsed;
-    #endif
+    while (*link && !pair_matches(map, *link, hash, key, keylen)) {
+        link = &(*link)->next;
+        length += 1;
+    }
 
-    return true;
+    if (chain_length) {
+        *chain_length = length;
+    }
+
+    return link;
 }
 
 /*
-Insert a new key-value pair into the hashmap, or update the associated value if the key already
-exists in the hashmap.
+Find the slot of a key in the open-addressed table.
 
-"keylen" is the length of the key in bytes.
+Groups of control bytes are probed in a triangular sequence starting at the group selected by the
+high bits of the hash. Within a group, all slots whose control byte equals the 7-bit tag of the
+hash are candidates, and only for those is the key itself compared. A probe ends at the first group
+that contains an empty slot.
+
+If "insert_idx" is not NULL, it is set to the first free (empty or deleted) slot encountered, i.e.
+the slot a new pair for the key should be stored in, or to SLOT_NONE if the table has no free slot
+left (which only happens after growing the table has failed).
 
 RETURN VALUE:
-    On success, true is returned.
-    On failure, false is returned.
+    The index of the slot holding the key, or SLOT_NONE if the key is not in the map.
 */
-bool
-bhm_set(BHashMap *map, const void *key, const size_t keylen, const void *data) {
-    #ifdef BHM_DEBUG_BENCHMARK
-    const uint64_t bench_start_nanos = start_benchmark();
-    #endif
-
-    HashPair **bucket = find_bucket(map, key, keylen);
-    
-    /* best case - no bucket at idx */
-    if (*bucket == NULL) {
-        *bucket = create_pair(keylen);
-        if (!(*bucket)) {
-            return false;
-        }
-
-        insert_pair(*bucket, key, keylen, data);
-
-        map->pair_count += 1;
+static inline size_t
+open_find(const BHashMap *map, const uint64_t hash, const void *key, const size_t keylen, size_t *insert_idx) {
+    const size_t group_mask = map->capacity / BHM_CTRL_GROUP_WIDTH - 1;
+    const int8_t tag = BHM_CTRL_TAG(hash);
 
-        #ifdef BHM_DEBUG_BENCHMARK
-        uint64_t time_elapsed = end_benchmark(bench_start_nanos);
-        map->debug_benchmark_times.bhm_set_total_ms += time_elapsed;
-        #endif
+    size_t group = (hash >> 7) & group_mask;
 
-        if (get_load_factor(map) >= map->config.max_load_factor) {
-            resize(map);
-        }
-
-        return true;
+    if (insert_idx) {
+        *insert_idx = SLOT_NONE;
     }
 
-    /* bucket present at idx */
+    for (size_t step = 1; step <= group_mask + 1; step++) {
+        const size_t base = group * BHM_CTRL_GROUP_WIDTH;
+        const int8_t *ctrl = &map->ctrl[base];
 
-    HashPair *head = *bucket;
+        for (bhm_ctrl_mask match = bhm_ctrl_group_match(ctrl, tag); match; match &= match - 1) {
+            const Slot *slot = slot_at(map, map->slots, base + BHM_CTRL_MASK_FIRST(match));
 
-    while (head) {
-        if (head->keylen == keylen && memcmp(key, head->key, keylen) == 0) {
-            /* found the key already in the map - update its value */
-            head->value = data;
+            if (slot->hash == hash && slot->keylen == keylen && keys_equal(key, slot_key(slot), keylen)) {
+                return base + BHM_CTRL_MASK_FIRST(match);
+            }
+        }
 
-            #ifdef BHM_DEBUG_BENCHMARK
-            uint64_t time_elapsed = end_benchmark(bench_start_nanos);
-            map->debug_benchmark_times.bhm_set_total_ms += time_elapsed;
-            #endif
+        if (insert_idx && *insert_idx == SLOT_NONE) {
+            const bhm_ctrl_mask free_mask = bhm_ctrl_group_match_free(ctrl);
 
-            return true;
+            if (free_mask) {
+                *insert_idx = base + BHM_CTRL_MASK_FIRST(free_mask);
+            }
         }
 
-        if (head->next == NULL) {
-            /* at end of linked list - allocate space for new pair and copy data over */
-            HashPair *new_pair = create_pair(keylen);
-            if (!new_pair) {
-                return false;
+        if (bhm_ctrl_group_match_empty(ctrl)) {
+            return SLOT_NONE;
+        }
+
+        group = (group + step) & group_mask;
+    }
+
+    return SLOT_NONE;
+}
+
+/*
+Find the slot a key of "hash" goes into in a table that holds no deleted slots and no duplicate
+keys, such as one being rebuilt: the first empty slot of its probe sequence.
+*/
+static inline size_t
+ctrl_find_empty(const int8_t *ctrl, const size_t capacity, const uint64_t hash) {
+    const size_t group_mask = capacity / BHM_CTRL_GROUP_WIDTH - 1;
+
+    size_t group = (hash >> 7) & group_mask;
+
+    for (size_t step = 1; ; step++) {
+        const bhm_ctrl_mask empty = bhm_ctrl_group_match_empty(&ctrl[group * BHM_CTRL_GROUP_WIDTH]);
+
+        if (empty) {
+            return group * BHM_CTRL_GROUP_WIDTH + BHM_CTRL_MASK_FIRST(empty);
+        }
+
+        group = (group + step) & group_mask;
+    }
+}
+
+/*
+Rebuild the open-addressed table with "capacity_new" slots, dropping all deleted slots.
+
+On failure, the hash map remains just as it was before the call.
+
+RETURN VALUE:
+    On success, true is returned.
+    On failure, false is returned.
+*/
+static bool
+open_rehash(BHashMap *map, const size_t capacity_new) {
+    const uint64_t bench_start_nanos = start_benchmark();
+    const size_t capacity_old = map->capacity;
+
+    int8_t *ctrl_new,
+           *ctrl_old = map->ctrl;
+    Slot *slots_new,
+         *slots_old = map->slots;
+
+    if (!open_alloc_table(map, capacity_new, &ctrl_new, &slots_new)) {
+        DEBUG_PRINT("\trehashing %lu -> %lu failed\n", capacity_old, capacity_new);
+        return false;
+    }
+
+    for (size_t idx_old = 0; idx_old < capacity_old; idx_old++) {
+        if (ctrl_old[idx_old] < 0) {
+            continue;
+        }
+
+        const Slot *slot = slot_at(map, slots_old, idx_old);
+        const size_t idx_new = ctrl_find_empty(ctrl_new, capacity_new, slot->hash);
+
+        ctrl_new[idx_new] = BHM_CTRL_TAG(slot->hash);
+        memcpy(slot_at(map, slots_new, idx_new), slot, map->slot_size);
+    }
+
+    free(ctrl_old);
+    free(slots_old);
+
+    map->ctrl = ctrl_new;
+    map->slots = slots_new;
+    map->capacity = capacity_new;
+    map->tombstone_count = 0;
+    update_resize_threshold(map);
+
+    count_rebuild(map, bench_start_nanos);
+
+    DEBUG_PRINT("rehashed %lu -> %lu slots\n", capacity_old, capacity_new);
+
+    return true;
+}
+
+/*
+Fill in a slot (or dense entry) for a new pair, copying the key into the slot or out of line.
+RETURN VALUE:
+    On success, true is returned.
+    On failure, false is returned.
+*/
+static inline bool
+slot_init(BHashMap *map, Slot *slot, const uint64_t hash, const void *key, const size_t keylen, const void *data) {
+    slot->hash = hash;
+    slot->keylen = keylen;
+
+    if (keylen <= SLOT_INLINE_KEY_MAX) {
+        memcpy(slot->key.bytes, key, keylen);
+    } else if (map->config.borrow_keys) {
+        slot->key.ptr = key;
+    } else {
+        unsigned char *key_copy = map_alloc(map, keylen);
+        if (!key_copy) {
+            return false;
+        }
+
+        memcpy(key_copy, key, keylen);
+        slot->key.ptr = key_copy;
+    }
+
+    value_set(map, &slot->value, data);
+
+    return true;
+}
+
+/*
+Find the slot of a key with a precomputed hash in the open-addressed table, inserting the key with
+"data" as its value if it isn't in the map yet. "inserted" is set to whether it was inserted.
+RETURN VALUE:
+    On success, the "value" member of the slot of the key.
+    On failure, NULL.
+*/
+static const void **
+open_entry(BHashMap *map, const uint64_t hash, const void *key, const size_t keylen, const void *data, bool *inserted) {
+    size_t insert_idx;
+    const size_t idx = open_find(map, hash, key, keylen, &insert_idx);
+
+    *inserted = idx == SLOT_NONE;
+
+    if (idx != SLOT_NONE) {
+        return &slot_at(map, map->slots, idx)->value;
+    }
+
+    /*
+    Every slot holds a pair (deleted slots would be free): the table should have grown long before,
+    but that failed to allocate. Try again, and fail the insert if it still can't grow.
+    */
+    if (insert_idx == SLOT_NONE) {
+        if (!open_rehash(map, open_round_capacity(map->capacity * map->config.resize_growth_factor))) {
+            return NULL;
+        }
+
+        open_find(map, hash, key, keylen, &insert_idx);
+    }
+
+    /* the slot is free, so it is only marked full once it has been filled in successfully */
+    if (!slot_init(map, slot_at(map, map->slots, insert_idx), hash, key, keylen, data)) {
+        return NULL;
+    }
+
+    if (map->ctrl[insert_idx] == BHM_CTRL_DELETED) {
+        map->tombstone_count -= 1;
+    }
+
+    map->ctrl[insert_idx] = BHM_CTRL_TAG(hash);
+
+    map->pair_count += 1;
+
+    /* deleted slots lengthen probes just like live ones, so they count towards the load */
+    if (map->pair_count + map->tombstone_count >= map->resize_threshold) {
+        /* if most of the load is deleted slots, purging them is enough */
+        const size_t capacity_new = map->pair_count < map->tombstone_count
+                                  ? map->capacity
+                                  : open_round_capacity(map->capacity * map->config.resize_growth_factor);
+
+        /* the rehash moves the new slot along with the rest */
+        if (open_rehash(map, capacity_new)) {
+            insert_idx = open_find(map, hash, key, keylen, NULL);
+        }
+    }
+
+    return &slot_at(map, map->slots, insert_idx)->value;
+}
+
+static void *
+open_get(const BHashMap *map, const uint64_t hash, const void *key, const size_t keylen) {
+    const size_t idx = open_find(map, hash, key, keylen, NULL);
+
+    return idx != SLOT_NONE ? value_get(map, &slot_at(map, map->slots, idx)->value) : NULL;
+}
+
+/*
+Mark the slot "idx" of the open-addressed table (or the index of a dense map) as free.
+*/
+static inline void
+ctrl_erase(BHashMap *map, const size_t idx) {
+    /*
+    A group that has an empty slot has had one ever since the last rehash, so no probe has ever
+    continued past it and the slot can be marked empty instead of deleted.
+    */
+    if (bhm_ctrl_group_match_empty(&map->ctrl[idx - idx % BHM_CTRL_GROUP_WIDTH])) {
+        map->ctrl[idx] = BHM_CTRL_EMPTY;
+    } else {
+        map->ctrl[idx] = BHM_CTRL_DELETED;
+        map->tombstone_count += 1;
+    }
+}
+
+static bool
+open_remove(BHashMap *map, const uint64_t hash, const void *key, const size_t keylen) {
+    const size_t idx = open_find(map, hash, key, keylen, NULL);
+
+    if (idx == SLOT_NONE) {
+        return false;
+    }
+
+    slot_free_key(map, slot_at(map, map->slots, idx));
+    ctrl_erase(map, idx);
+
+    map->pair_count -= 1;
+
+    return true;
+}
+
+/*
+Find the index slot of a key in the index of a dense map, probing it like open_find does the
+open-addressed table.
+*/
+static inline size_t
+dense_find(const BHashMap *map, const uint64_t hash, const void *key, const size_t keylen, size_t *insert_idx) {
+    const size_t group_mask = map->capacity / BHM_CTRL_GROUP_WIDTH - 1;
+    const int8_t tag = BHM_CTRL_TAG(hash);
+
+    size_t group = (hash >> 7) & group_mask;
+
+    if (insert_idx) {
+        *insert_idx = SLOT_NONE;
+    }
+
+    for (size_t step = 1; step <= group_mask + 1; step++) {
+        const size_t base = group * BHM_CTRL_GROUP_WIDTH;
+        const int8_t *ctrl = &map->ctrl[base];
+
+        for (bhm_ctrl_mask match = bhm_ctrl_group_match(ctrl, tag); match; match &= match - 1) {
+            const Slot *entry = slot_at(map, map->entries, map->indices[base + BHM_CTRL_MASK_FIRST(match)]);
+
+            if (entry->hash == hash && entry->keylen == keylen && keys_equal(key, slot_key(entry), keylen)) {
+                return base + BHM_CTRL_MASK_FIRST(match);
+            }
+        }
+
+        if (insert_idx && *insert_idx == SLOT_NONE) {
+            const bhm_ctrl_mask free_mask = bhm_ctrl_group_match_free(ctrl);
+
+            if (free_mask) {
+                *insert_idx = base + BHM_CTRL_MASK_FIRST(free_mask);
+            }
+        }
+
+        if (bhm_ctrl_group_match_empty(ctrl)) {
+            return SLOT_NONE;
+        }
+
+        group = (group + step) & group_mask;
+    }
+
+    return SLOT_NONE;
+}
+
+/*
+Rebuild the index of a dense map with "capacity_new" slots, and compact its entries, dropping the
+removed ones while keeping the rest in insertion order. The entry array is resized to hold as many
+entries as the new index can take before reaching its maximum load factor, so that the two fill
+up together.
+
+On failure, the hash map remains just as it was before the call.
+
+RETURN VALUE:
+    On success, true is returned.
+    On failure, false is returned.
+*/
+static bool
+dense_rebuild(BHashMap *map, const size_t capacity_new) {
+    const uint64_t bench_start_nanos = start_benchmark();
+
+    /* the first build of the index, by bhm_create, isn't a rebuild */
+    const bool is_rebuild = map->ctrl != NULL;
+
+    const size_t capacity_old = map->capacity,
+                 entry_capacity_new = load_threshold(map, capacity_new);
+
+    /* positions of entries are stored in 32 bits */
+    if (entry_capacity_new > UINT32_MAX) {
+        return false;
+    }
+
+    int8_t *ctrl_new = aligned_alloc(BHM_CTRL_GROUP_WIDTH, capacity_new);
+    uint32_t *indices_new = malloc(capacity_new * sizeof(uint32_t));
+
+    if (!ctrl_new || !indices_new) {
+        free(ctrl_new);
+        free(indices_new);
+        return false;
+    }
+
+    if (entry_capacity_new > map->entry_capacity) {
+        Slot *entries_new = realloc(map->entries, entry_capacity_new * map->slot_size);
+
+        if (!entries_new) {
+            free(ctrl_new);
+            free(indices_new);
+            return false;
+        }
+
+        map->entries = entries_new;
+        map->entry_capacity = entry_capacity_new;
+    }
+
+    memset(ctrl_new, BHM_CTRL_EMPTY, capacity_new);
+
+    size_t entry_count = 0;
+
+    for (size_t i = 0; i < map->entry_count; i++) {
+        const Slot *entry = slot_at(map, map->entries, i);
+
+        if (entry->keylen == DENSE_ENTRY_REMOVED) {
+            continue;
+        }
+
+        const size_t idx = ctrl_find_empty(ctrl_new, capacity_new, entry->hash);
+
+        ctrl_new[idx] = BHM_CTRL_TAG(entry->hash);
+        indices_new[idx] = entry_count;
+
+        memmove(slot_at(map, map->entries, entry_count), entry, map->slot_size);
+
+        entry_count += 1;
+    }
+
+    /* a smaller index (see shrink) holds fewer entries; once they are compacted, the rest can go */
+    if (entry_capacity_new < map->entry_capacity) {
+        Slot *entries_new = realloc(map->entries, entry_capacity_new * map->slot_size);
+
+        /* if the array can't be shrunk, its tail just goes unused */
+        if (entries_new) {
+            map->entries = entries_new;
+        }
+
+        map->entry_capacity = entry_capacity_new;
+    }
+
+    free(map->ctrl);
+    free(map->indices);
+
+    map->ctrl = ctrl_new;
+    map->indices = indices_new;
+    map->capacity = capacity_new;
+    map->entry_count = entry_count;
+    map->tombstone_count = 0;
+    update_resize_threshold(map);
+
+    if (is_rebuild) {
+        count_rebuild(map, bench_start_nanos);
+    }
+
+    DEBUG_PRINT("rebuilt %lu -> %lu slots\n", capacity_old, capacity_new);
+    (void) capacity_old;
+
+    return true;
+}
+
+/*
+Find the entry of a key with a precomputed hash in a dense map, like open_entry. New pairs are
+appended to the entry array.
+*/
+static const void **
+dense_entry(BHashMap *map, const uint64_t hash, const void *key, const size_t keylen, const void *data, bool *inserted) {
+    size_t insert_idx;
+    const size_t idx = dense_find(map, hash, key, keylen, &insert_idx);
+
+    *inserted = idx == SLOT_NONE;
+
+    if (idx != SLOT_NONE) {
+        return &slot_at(map, map->entries, map->indices[idx])->value;
+    }
+
+    if (map->entry_count == map->entry_capacity) {
+        /* out of entries: if enough of them have been removed, compacting them away is enough */
+        const size_t removed_count = map->entry_count - map->pair_count;
+        const size_t capacity_new = removed_count > 0 && removed_count >= map->entry_count / 4
+                                  ? map->capacity
+                                  : open_round_capacity(map->capacity * map->config.resize_growth_factor);
+
+        if (!dense_rebuild(map, capacity_new)) {
+            return NULL;
+        }
+
+        dense_find(map, hash, key, keylen, &insert_idx);
+    }
+
+    Slot *entry = slot_at(map, map->entries, map->entry_count);
+    if (!slot_init(map, entry, hash, key, keylen, data)) {
+        return NULL;
+    }
+
+    if (map->ctrl[insert_idx] == BHM_CTRL_DELETED) {
+        map->tombstone_count -= 1;
+    }
+
+    map->ctrl[insert_idx] = BHM_CTRL_TAG(hash);
+    map->indices[insert_idx] = map->entry_count;
+
+    map->entry_count += 1;
+    map->pair_count += 1;
+
+    return &entry->value;
+}
+
+static void *
+dense_get(const BHashMap *map, const uint64_t hash, const void *key, const size_t keylen) {
+    const size_t idx = dense_find(map, hash, key, keylen, NULL);
+
+    return idx != SLOT_NONE ? value_get(map, &slot_at(map, map->entries, map->indices[idx])->value) : NULL;
+}
+
+/*
+Remove a key from a dense map. Its entry is only marked removed, so that the entries after it keep
+their positions; removed entries are compacted away once the entry array fills up.
+*/
+static bool
+dense_remove(BHashMap *map, const uint64_t hash, const void *key, const size_t keylen) {
+    const size_t idx = dense_find(map, hash, key, keylen, NULL);
+
+    if (idx == SLOT_NONE) {
+        return false;
+    }
+
+    Slot *entry = slot_at(map, map->entries, map->indices[idx]);
+
+    slot_free_key(map, entry);
+    entry->keylen = DENSE_ENTRY_REMOVED;
+
+    /* the most recently inserted entry can be dropped right away */
+    if (map->indices[idx] == map->entry_count - 1) {
+        map->entry_count -= 1;
+    }
+
+    ctrl_erase(map, idx);
+
+    map->pair_count -= 1;
+
+    return true;
+}
+
+/*
+Draw a new seed for the hash function of a chaining map and rehash every pair with it, keeping
+the capacity. A chain longer than max_chain_length is no accident with a random seed: the keys
+were picked to collide under the current one, and they are spread out again by a seed that their
+supplier doesn't know.
+
+Reseeding doesn't help if the keys collide under every seed (a 32-bit "hashfunc" takes none, and
+a custom "hashfunc64" may ignore it). So that such a map isn't rehashed on every insert, it is only
+reseeded again once it has doubled in size.
+*/
+static void
+chain_reseed(BHashMap *map) {
+    map->reseed_min_count = map->pair_count * 2;
+
+    if (!hashing_reseed(&map->config)) {
+        return;
+    }
+
+    if (map->buckets_old) {
+        migrate_buckets(map, SIZE_MAX);
+    }
+
+    /* unlink every pair into one list first, so that no pair is rehashed twice */
+    HashPair *pairs = NULL;
+
+    for (size_t i = 0; i < map->capacity; i++) {
+        HashPair *head = map->buckets[i];
+
+        while (head) {
+            HashPair *n = head->next;
+            head->next = pairs;
+            pairs = head;
+            head = n;
+        }
+
+        map->buckets[i] = NULL;
+    }
+
+    for (HashPair *pair = pairs; pair; pair = pair->next) {
+        pair->hash = hashing_hash(&map->config, pair_key(map, pair), pair->keylen);
+    }
+
+    move_chain(map, pairs);
+
+    map->reseed_count += 1;
+
+    DEBUG_PRINT("reseeded after %lu pairs\n", map->pair_count);
+}
+
+/*
+Find the pair of a key with a precomputed hash in the chained table, like open_entry. Pairs never
+move, so neither resizing nor reseeding invalidates the returned value.
+
+The insert may reseed the hash function (see chain_reseed), after which hashes computed before the
+call no longer match.
+*/
+static const void **
+chain_entry(BHashMap *map, const uint64_t hash, const void *key, const size_t keylen, const void *data, bool *inserted) {
+    migrate_step(map);
+
+    size_t chain_length;
+    HashPair **link = chain_find(map, hash, key, keylen, &chain_length);
+
+    *inserted = *link == NULL;
+
+    if (*link) {
+        return &(*link)->value;
+    }
+
+    /* at end of linked list (or an empty bucket) - allocate space for new pair and copy data over */
+    HashPair *new_pair = create_pair(map, keylen, hash);
+    if (!new_pair) {
+        return NULL;
+    }
+
+    insert_pair(map, new_pair, key, keylen, data);
+
+    *link = new_pair;
+
+    map->pair_count += 1;
+
+    if (map->pair_count >= map->resize_threshold) {
+        resize(map);
+    }
+
+    if (chain_length >= map->config.max_chain_length && map->pair_count >= map->reseed_min_count
+        && !atomic_load_explicit(&map->seed_pinned, memory_order_relaxed)) {
+        chain_reseed(map);
+    }
+
+    return &new_pair->value;
+}
+
+static void *
+chain_get(const BHashMap *map, const uint64_t hash, const void *key, const size_t keylen) {
+    /* lookups take part in migrating buckets as well, or a read-mostly map would never finish a resize */
+    migrate_step((BHashMap *) map);
+
+    const HashPair *pair = *chain_find(map, hash, key, keylen, NULL);
+
+    return pair ? value_get(map, &pair->value) : NULL;
+}
+
+static bool
+chain_remove(BHashMap *map, const uint64_t hash, const void *key, const size_t keylen) {
+    migrate_step(map);
+
+    /* the link pointing to the pair, so that unlinking the head and an inner pair is the same */
+    HashPair **link = chain_find(map, hash, key, keylen, NULL);
+    HashPair *pair = *link;
+
+    if (!pair) {
+        return false;
+    }
+
+    *link = pair->next;
+    map_free(map, pair, pair_size(map, pair->keylen));
+
+    map->pair_count -= 1;
+
+    return true;
+}
+
+/*
+The capacity a table of the map needs to hold "count" pairs without resizing: the smallest one
+whose resize threshold lies above "count".
+*/
+static inline size_t
+capacity_for(const BHashMap *map, const size_t count) {
+    const size_t capacity = (size_t) ((double) count / map->config.max_load_factor) + 1;
+
+    return map->config.backend == BHM_BACKEND_CHAINING
+         ? chain_round_capacity(map, capacity)
+         : open_round_capacity(capacity);
+}
+
+/*
+Rebuild the table of the map with "capacity_new" buckets or slots, which may be fewer than it has
+now as long as they hold all its pairs.
+RETURN VALUE:
+    On success, true is returned.
+    On failure, false is returned and the map remains just as it was before the call.
+*/
+static bool
+rebuild_table(BHashMap *map, const size_t capacity_new) {
+    switch (map->config.backend) {
+        case BHM_BACKEND_OPEN_ADDRESSING:
+            return open_rehash(map, capacity_new);
+        case BHM_BACKEND_DENSE:
+            return dense_rebuild(map, capacity_new);
+        case BHM_BACKEND_CHAINING:
+            return chain_resize(map, capacity_new);
+        default:
+            return false;
+    }
+}
+
+/*
+Shrink the table of a map whose load has dropped below its minimum load factor. The new table is
+sized for twice the remaining pairs, which leaves it between a quarter and half of its maximum
+load, so that neither the next inserts nor the next removals resize it again right away.
+*/
+static void
+shrink(BHashMap *map) {
+    const size_t capacity_new = capacity_for(map, map->pair_count * 2);
+
+    if (capacity_new < map->capacity) {
+        rebuild_table(map, capacity_new);
+    }
+}
+
+/*
+Number of groups of control bytes probed to reach slot "idx" of a table, or to find out that a key
+isn't in it if "idx" is SLOT_NONE (see open_find).
+*/
+static size_t
+probe_groups(const int8_t *ctrl, const size_t capacity, const uint64_t hash, const size_t idx) {
+    const size_t group_mask = capacity / BHM_CTRL_GROUP_WIDTH - 1;
+
+    size_t group = (hash >> 7) & group_mask;
+
+    for (size_t step = 1; step <= group_mask + 1; step++) {
+        if (idx == SLOT_NONE ? bhm_ctrl_group_match_empty(&ctrl[group * BHM_CTRL_GROUP_WIDTH]) != 0 : idx / BHM_CTRL_GROUP_WIDTH == group) {
+            return step;
+        }
+
+        group = (group + step) & group_mask;
+    }
+
+    return group_mask + 1;
+}
+
+/*
+Number of probes a lookup of a key takes: pairs compared along its chain(s) with chaining, groups
+of control bytes probed otherwise. "found" is set to whether the key is in the map.
+*/
+static size_t
+probe_length(const BHashMap *map, const uint64_t hash, const void *key, const size_t keylen, bool *found) {
+    size_t idx;
+    const int8_t *ctrl = map->ctrl;
+
+    switch (map->config.backend) {
+        case BHM_BACKEND_OPEN_ADDRESSING:
+            idx = open_find(map, hash, key, keylen, NULL);
+            break;
+        case BHM_BACKEND_DENSE:
+            idx = dense_find(map, hash, key, keylen, NULL);
+            break;
+        case BHM_BACKEND_SNAPSHOT:
+            idx = snapshot_find(&map->snapshot, hash, key, keylen);
+            ctrl = map->snapshot.ctrl;
+            break;
+        default: {
+            size_t length = 0;
+
+            if (map->buckets_old) {
+                const size_t idx_old = bucket_index(map->config.indexing, hash, map->capacity_old);
+
+                for (const HashPair *pair = idx_old >= map->migrate_idx ? map->buckets_old[idx_old] : NULL; pair; pair = pair->next) {
+                    length += 1;
+
+                    if (pair_matches(map, pair, hash, key, keylen)) {
+                        *found = true;
+                        return length;
+                    }
+                }
+            }
+
+            for (const HashPair *pair = *find_bucket(map, hash); pair; pair = pair->next) {
+                length += 1;
+
+                if (pair_matches(map, pair, hash, key, keylen)) {
+                    *found = true;
+                    return length;
+                }
+            }
+
+            *found = false;
+            return length;
+        }
+    }
+
+    *found = idx != SLOT_NONE;
+
+    return probe_groups(ctrl, map->capacity, hash, idx);
+}
+
+/*
+Count an operation on a key for bhm_get_stats. The probe sequence of the key is walked a second
+time to measure it, so that the lookups themselves stay free of counting.
+*/
+static void
+count_operation(BHashMap *map, const uint64_t hash, const void *key, const size_t keylen) {
+    bool found;
+
+    map->probe_count += probe_length(map, hash, key, keylen, &found);
+    map->operation_count += 1;
+    map->hit_count += found;
+    map->miss_count += !found;
+}
+
+/*
+Find the value of a key with a precomputed hash, inserting the key with "data" as its value if it
+isn't in the map yet, with a single probe. "inserted" is set to whether it was inserted.
+RETURN VALUE:
+    On success, the "value" member of the pair or slot of the key, valid until the map is next
+    modified.
+    On failure, NULL.
+*/
+static inline const void **
+entry_hashed(BHashMap *map, const uint64_t hash, const void *key, const size_t keylen, const void *data, bool *inserted) {
+    if (map->counters_enabled) {
+        count_operation(map, hash, key, keylen);
+    }
+
+    if (map->config.backend == BHM_BACKEND_OPEN_ADDRESSING) {
+        return open_entry(map, hash, key, keylen, data, inserted);
+    }
+
+    if (map->config.backend == BHM_BACKEND_DENSE) {
+        return dense_entry(map, hash, key, keylen, data, inserted);
+    }
+
+    if (map->config.backend == BHM_BACKEND_SNAPSHOT) {
+        *inserted = false;
+        return NULL;
+    }
+
+    return chain_entry(map, hash, key, keylen, data, inserted);
+}
+
+static inline bool
+set_hashed(BHashMap *map, const uint64_t hash, const void *key, const size_t keylen, const void *data) {
+    bool inserted;
+    const void **value = entry_hashed(map, hash, key, keylen, data, &inserted);
+
+    /* found the key already in the map - update its value */
+    if (value && !inserted) {
+        value_set(map, value, data);
+    }
+
+    return value != NULL;
+}
+
+static inline void *
+get_hashed(const BHashMap *map, const uint64_t hash, const void *key, const size_t keylen) {
+    if (map->counters_enabled) {
+        count_operation((BHashMap *) map, hash, key, keylen);
+    }
+
+    if (map->config.backend == BHM_BACKEND_OPEN_ADDRESSING) {
+        return open_get(map, hash, key, keylen);
+    }
+
+    if (map->config.backend == BHM_BACKEND_DENSE) {
+        return dense_get(map, hash, key, keylen);
+    }
+
+    if (map->config.backend == BHM_BACKEND_SNAPSHOT) {
+        const size_t idx = snapshot_find(&map->snapshot, hash, key, keylen);
+        return idx != SIZE_MAX ? snapshot_slot_value(&map->snapshot, &map->snapshot.slots[idx]) : NULL;
+    }
+
+    return chain_get(map, hash, key, keylen);
+}
+
+static inline bool
+remove_hashed(BHashMap *map, const uint64_t hash, const void *key, const size_t keylen) {
+    if (map->counters_enabled) {
+        count_operation(map, hash, key, keylen);
+    }
+
+    bool removed;
+
+    if (map->config.backend == BHM_BACKEND_OPEN_ADDRESSING) {
+        removed = open_remove(map, hash, key, keylen);
+    } else if (map->config.backend == BHM_BACKEND_DENSE) {
+        removed = dense_remove(map, hash, key, keylen);
+    } else if (map->config.backend == BHM_BACKEND_CHAINING) {
+        removed = chain_remove(map, hash, key, keylen);
+    } else {
+        return false;
+    }
+
+    if (removed && map->pair_count < map->shrink_threshold) {
+        shrink(map);
+    }
+
+    return removed;
+}
+
+/*
+Hash a key and set, get or remove it, recording the latency of the whole operation if it is
+sampled (see bhm_enable_latency).
+*/
+static inline bool
+set_key(BHashMap *map, const void *key, const size_t keylen, const void *data) {
+    const uint64_t start_nanos = latency_start(map);
+    const bool ok = set_hashed(map, hashing_hash(&map->config, key, keylen), key, keylen, data);
+
+    latency_end(map, BHM_OPERATION_SET, start_nanos);
+
+    return ok;
+}
+
+static inline const void **
+entry_key(BHashMap *map, const void *key, const size_t keylen, const void *data, bool *inserted) {
+    const uint64_t start_nanos = latency_start(map);
+    const void **value = entry_hashed(map, hashing_hash(&map->config, key, keylen), key, keylen, data, inserted);
+
+    latency_end(map, BHM_OPERATION_SET, start_nanos);
+
+    return value;
+}
+
+static inline void *
+get_key(const BHashMap *map, const void *key, const size_t keylen) {
+    /* like the migration steps of chain_get, recording latency writes to a map that is otherwise only read */
+    const uint64_t start_nanos = latency_start((BHashMap *) map);
+    void *value = get_hashed(map, hashing_hash(&map->config, key, keylen), key, keylen);
+
+    latency_end((BHashMap *) map, BHM_OPERATION_GET, start_nanos);
+
+    return value;
+}
+
+static inline bool
+remove_key(BHashMap *map, const void *key, const size_t keylen) {
+    const uint64_t start_nanos = latency_start(map);
+    const bool removed = remove_hashed(map, hashing_hash(&map->config, key, keylen), key, keylen);
+
+    latency_end(map, BHM_OPERATION_REMOVE, start_nanos);
+
+    return removed;
+}
+
+/*
+Keep the hash function of the map from ever being reseeded (see chain_reseed), because the caller
+may hold on to hashes computed with its current seed: through bhm_hash, or by passing them to the
+_hashed functions. A reseed would silently make those hashes miss.
+
+Pinning has to happen from lookups too (bhm_hash, bhm_get_hashed), since a later insert could
+reseed, and concurrent lookups may pin at the same time: the flag is a relaxed atomic, only
+written the first time. It needs no ordering, as it is only read by inserts, which must not run
+concurrently with anything anyway. Lookups can still write for other reasons: counters, latency
+recording, and the migration steps of a chaining map with an "incremental_resize_step" (see
+migrate_step).
+*/
+static inline void
+pin_seed(const BHashMap *map) {
+    BHashMap *mutable_map = (BHashMap *) map;
+
+    if (!atomic_load_explicit(&mutable_map->seed_pinned, memory_order_relaxed)) {
+        atomic_store_explicit(&mutable_map->seed_pinned, true, memory_order_relaxed);
+    }
+}
+
+/*
+Insert a new key-value pair into the hashmap, or update the associated value if the key already
+exists in the hashmap.
+
+"keylen" is the length of the key in bytes. With inline values (value_size in the config),
+value_size bytes are copied from "data" into the map, or zeroes if "data" is NULL.
+
+RETURN VALUE:
+    On success, true is returned.
+    On failure, false is returned.
+*/
+bool
+bhm_set(BHashMap *map, const void *key, const size_t keylen, const void *data) {
+    return set_key(map, key, keylen, data);
+}
+
+/*
+Get the value of a key from the map. With inline values, this is a pointer to the value inside the
+map, valid until the map is next modified.
+RETURN VALUE:
+    NULL     - key not found / error
+    NON-NULL - appropriate data
+*/
+void *
+bhm_get(const BHashMap *map, const void *key, const size_t keylen) {
+    return get_key(map, key, keylen);
+}
+
+/* remove a key from the hash map */
+bool
+bhm_remove(BHashMap *map, const void *key, const size_t keylen) {
+    return remove_key(map, key, keylen);
+}
+
+/*
+Get the value of a key, inserting the key with "data" as its value (as bhm_set would) if it isn't
+in the map yet, with a single lookup. If "inserted" is not NULL, it is set to whether the key was
+inserted.
+
+The value can be modified through the returned pointer, which is valid until the map is next
+modified: with inline values, it points to the value itself, and otherwise to the stored value
+pointer (a "void **").
+RETURN VALUE:
+    On success, a pointer to the value of the key.
+    On failure (including on a snapshot), NULL.
+*/
+void *
+bhm_get_or_insert(BHashMap *map, const void *key, const size_t keylen, const void *data, bool *inserted) {
+    bool key_inserted;
+    const void **value = entry_key(map, key, keylen, data, &key_inserted);
+
+    if (inserted) {
+        *inserted = key_inserted;
+    }
+
+    return (void *) value;
+}
+
+/*
+Call "callback" on the value of a key, inserting the key first if it isn't in the map yet, with a
+single lookup. A new key starts out with a NULL value pointer, or with zeroes as its inline value.
+The callback gets a pointer to the value like the one returned by bhm_get_or_insert, whether the
+key was inserted, and "ctx", and must not modify the map.
+RETURN VALUE:
+    On success, true is returned.
+    On failure, false is returned and the callback isn't called.
+*/
+bool
+bhm_upsert(BHashMap *map, const void *key, const size_t keylen, bhm_upsert_callback callback, void *ctx) {
+    bool inserted;
+    void *value = bhm_get_or_insert(map, key, keylen, NULL, &inserted);
+
+    if (!value) {
+        return false;
+    }
+
+    callback(value, inserted, ctx);
+
+    return true;
+}
+
+/*
+Return the hash the map computes for a key, for use with the _hashed functions. From then on, the
+hash function of the map is never reseeded (see chain_reseed), so the hash stays valid for as long
+as the map exists. Other maps compute the same hash only if they have the same hash function and
+the same seed: as seeds are random by default, such maps must be given one (see bhm_get_config).
+*/
+uint64_t
+bhm_hash(const BHashMap *map, const void *key, const size_t keylen) {
+    pin_seed(map);
+
+    return hashing_hash(&map->config, key, keylen);
+}
+
+/*
+Variants of bhm_set, bhm_get, bhm_remove and bhm_get_or_insert for a key whose hash the caller has
+already computed, with bhm_hash on this map or on any map with the same hash function and seed.
+The key isn't hashed again; a hash that isn't that of the key makes the operation go wrong (a
+lookup misses, an insert adds a second copy of the key). Calling any of them keeps the hash
+function of the map from being reseeded, like bhm_hash.
+*/
+bool
+bhm_set_hashed(BHashMap *map, const uint64_t hash, const void *key, const size_t keylen, const void *data) {
+    pin_seed(map);
+
+    const uint64_t start_nanos = latency_start(map);
+    const bool ok = set_hashed(map, hash, key, keylen, data);
+
+    latency_end(map, BHM_OPERATION_SET, start_nanos);
+
+    return ok;
+}
+
+void *
+bhm_get_hashed(const BHashMap *map, const uint64_t hash, const void *key, const size_t keylen) {
+    pin_seed(map);
+
+    const uint64_t start_nanos = latency_start((BHashMap *) map);
+    void *value = get_hashed(map, hash, key, keylen);
+
+    latency_end((BHashMap *) map, BHM_OPERATION_GET, start_nanos);
+
+    return value;
+}
+
+bool
+bhm_remove_hashed(BHashMap *map, const uint64_t hash, const void *key, const size_t keylen) {
+    pin_seed(map);
+
+    const uint64_t start_nanos = latency_start(map);
+    const bool removed = remove_hashed(map, hash, key, keylen);
+
+    latency_end(map, BHM_OPERATION_REMOVE, start_nanos);
+
+    return removed;
+}
+
+void *
+bhm_get_or_insert_hashed(BHashMap *map, const uint64_t hash, const void *key, const size_t keylen, const void *data, bool *inserted) {
+    pin_seed(map);
+
+    bool key_inserted;
+
+    const uint64_t start_nanos = latency_start(map);
+    const void **value = entry_hashed(map, hash, key, keylen, data, &key_inserted);
+
+    latency_end(map, BHM_OPERATION_SET, start_nanos);
+
+    if (inserted) {
+        *inserted = key_inserted;
+    }
+
+    return (void *) value;
+}
+
+/*
+Integer-key variants of bhm_set, bhm_get and bhm_remove. A key is the bytes of the integer in
+native byte order, so bhm_set_u64(map, id, data) and bhm_set(map, &id, sizeof(id), data) set the
+same key, and the variants can be mixed freely with the generic functions.
+
+With a built-in hash function, integer keys are hashed by a bijective mixer rather than a full
+hash pass, and stored inline in the slots of an open-addressed table.
+*/
+bool
+bhm_set_u64(BHashMap *map, const uint64_t key, const void *data) {
+    return set_key(map, &key, sizeof(key), data);
+}
+
+void *
+bhm_get_u64(const BHashMap *map, const uint64_t key) {
+    return get_key(map, &key, sizeof(key));
+}
+
+bool
+bhm_remove_u64(BHashMap *map, const uint64_t key) {
+    return remove_key(map, &key, sizeof(key));
+}
+
+bool
+bhm_set_u32(BHashMap *map, const uint32_t key, const void *data) {
+    return set_key(map, &key, sizeof(key), data);
+}
+
+void *
+bhm_get_u32(const BHashMap *map, const uint32_t key) {
+    return get_key(map, &key, sizeof(key));
+}
+
+bool
+bhm_remove_u32(BHashMap *map, const uint32_t key) {
+    return remove_key(map, &key, sizeof(key));
+}
+
+/*
+Issue a prefetch for the first memory a lookup of "hash" will touch: the bucket (chaining) or the
+first group of control bytes (open addressing and snapshots).
+*/
+static inline void
+prefetch_bucket(const BHashMap *map, const uint64_t hash) {
+    if (map->config.backend != BHM_BACKEND_CHAINING) {
+        const int8_t *ctrl = map->config.backend == BHM_BACKEND_SNAPSHOT ? map->snapshot.ctrl : map->ctrl;
+        const size_t group_mask = map->capacity / BHM_CTRL_GROUP_WIDTH - 1;
+        __builtin_prefetch(&ctrl[((hash >> 7) & group_mask) * BHM_CTRL_GROUP_WIDTH]);
+    } else {
+        __builtin_prefetch(find_bucket(map, hash));
+    }
+}
+
+/*
+Issue a prefetch for the second memory a lookup of "hash" will touch, which is only known once
+the first has arrived: the head pair of the bucket (chaining), the first slot of the first group
+whose tag matches (open addressing) or the entry position in that slot of the index (dense).
+*/
+static inline void
+prefetch_entry(const BHashMap *map, const uint64_t hash) {
+    if (map->config.backend == BHM_BACKEND_OPEN_ADDRESSING) {
+        const size_t group_mask = map->capacity / BHM_CTRL_GROUP_WIDTH - 1,
+                     base = ((hash >> 7) & group_mask) * BHM_CTRL_GROUP_WIDTH;
+        const bhm_ctrl_mask match = bhm_ctrl_group_match(&map->ctrl[base], BHM_CTRL_TAG(hash));
+
+        if (match) {
+            __builtin_prefetch(slot_at(map, map->slots, base + BHM_CTRL_MASK_FIRST(match)));
+        }
+    } else if (map->config.backend == BHM_BACKEND_DENSE) {
+        const size_t group_mask = map->capacity / BHM_CTRL_GROUP_WIDTH - 1,
+                     base = ((hash >> 7) & group_mask) * BHM_CTRL_GROUP_WIDTH;
+        const bhm_ctrl_mask match = bhm_ctrl_group_match(&map->ctrl[base], BHM_CTRL_TAG(hash));
+
+        if (match) {
+            __builtin_prefetch(&map->indices[base + BHM_CTRL_MASK_FIRST(match)]);
+        }
+    } else if (map->config.backend == BHM_BACKEND_CHAINING) {
+        __builtin_prefetch(*find_bucket(map, hash));
+    }
+}
+
+/*
+For the open-addressed table, whose slots point to out-of-line copies of longer keys, issue a
+prefetch for the key of the first slot whose tag matches, which is only known once that slot has
+arrived. For a dense map, issue a prefetch for the entry the first matching slot of the index
+refers to.
+*/
+static inline void
+prefetch_key(const BHashMap *map, const uint64_t hash) {
+    if (map->config.backend == BHM_BACKEND_DENSE) {
+        const size_t group_mask = map->capacity / BHM_CTRL_GROUP_WIDTH - 1,
+                     base = ((hash >> 7) & group_mask) * BHM_CTRL_GROUP_WIDTH;
+        const bhm_ctrl_mask match = bhm_ctrl_group_match(&map->ctrl[base], BHM_CTRL_TAG(hash));
+
+        if (match) {
+            __builtin_prefetch(slot_at(map, map->entries, map->indices[base + BHM_CTRL_MASK_FIRST(match)]));
+        }
+
+        return;
+    }
+
+    if (map->config.backend != BHM_BACKEND_OPEN_ADDRESSING) {
+        return;
+    }
+
+    const size_t group_mask = map->capacity / BHM_CTRL_GROUP_WIDTH - 1,
+                 base = ((hash >> 7) & group_mask) * BHM_CTRL_GROUP_WIDTH;
+    const bhm_ctrl_mask match = bhm_ctrl_group_match(&map->ctrl[base], BHM_CTRL_TAG(hash));
+
+    if (match) {
+        const Slot *slot = slot_at(map, map->slots, base + BHM_CTRL_MASK_FIRST(match));
+
+        if (slot->keylen > SLOT_INLINE_KEY_MAX) {
+            __builtin_prefetch(slot->key.ptr);
+        }
+    }
+}
+
+/*
+Get the values of "n" keys at once. The value of keys[i] (or NULL if it isn't in the map) is
+stored in out_values[i].
+
+Keys are processed in chunks: all keys of a chunk are hashed first and prefetches are issued for
+their buckets, then for the pairs in those buckets, and only then are the lookups performed, so
+that the cache misses of the lookups in a chunk overlap instead of being serialized.
+*/
+static void
+get_batch(const BHashMap *map, const uint64_t *key_hashes, const void *const *keys, const size_t *keylens, void **out_values, const size_t n) {
+    uint64_t hashes[BHM_BATCH_CHUNK];
+
+    for (size_t start = 0; start < n; start += BHM_BATCH_CHUNK) {
+        const size_t count = n - start < BHM_BATCH_CHUNK ? n - start : BHM_BATCH_CHUNK;
+
+        for (size_t i = 0; i < count; i++) {
+            hashes[i] = key_hashes ? key_hashes[start + i] : hashing_hash(&map->config, keys[start + i], keylens[start + i]);
+            prefetch_bucket(map, hashes[i]);
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            prefetch_entry(map, hashes[i]);
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            prefetch_key(map, hashes[i]);
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            out_values[start + i] = get_hashed(map, hashes[i], keys[start + i], keylens[start + i]);
+        }
+    }
+}
+
+void
+bhm_get_batch(const BHashMap *map, const void *const *keys, const size_t *keylens, void **out_values, const size_t n) {
+    get_batch(map, NULL, keys, keylens, out_values, n);
+}
+
+/*
+bhm_get_batch for keys whose hashes the caller has already computed, like bhm_get_hashed: the hash
+of keys[i] is hashes[i].
+*/
+void
+bhm_get_batch_hashed(const BHashMap *map, const uint64_t *hashes, const void *const *keys, const size_t *keylens, void **out_values, const size_t n) {
+    pin_seed(map);
+    get_batch(map, hashes, keys, keylens, out_values, n);
+}
+
+/*
+Insert or update "n" key-value pairs at once, as if by calling bhm_set for keys[i] and values[i]
+in order, prefetching ahead like bhm_get_batch.
+RETURN VALUE:
+    If every pair was set, true is returned.
+    If setting any of the pairs failed, false is returned (the remaining pairs are still set).
+*/
+static bool
+set_batch(BHashMap *map, const uint64_t *key_hashes, const void *const *keys, const size_t *keylens, const void *const *values, const size_t n) {
+    uint64_t hashes[BHM_BATCH_CHUNK];
+    bool ok = true;
+
+    for (size_t start = 0; start < n; start += BHM_BATCH_CHUNK) {
+        const size_t count = n - start < BHM_BATCH_CHUNK ? n - start : BHM_BATCH_CHUNK;
+        const uint64_t seed = map->config.seed;
+
+        for (size_t i = 0; i < count; i++) {
+            hashes[i] = key_hashes ? key_hashes[start + i] : hashing_hash(&map->config, keys[start + i], keylens[start + i]);
+            prefetch_bucket(map, hashes[i]);
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            prefetch_entry(map, hashes[i]);
+        }
+
+        /*
+        An insert may resize the table, which only makes the remaining prefetches useless, not wrong.
+        It may also reseed the hash function, after which the remaining keys are hashed again.
+        */
+        for (size_t i = 0; i < count; i++) {
+            const uint64_t hash = map->config.seed == seed
+                                ? hashes[i]
+                                : hashing_hash(&map->config, keys[start + i], keylens[start + i]);
+
+            ok &= set_hashed(map, hash, keys[start + i], keylens[start + i], values[start + i]);
+        }
+    }
+
+    return ok;
+}
+
+bool
+bhm_set_batch(BHashMap *map, const void *const *keys, const size_t *keylens, const void *const *values, const size_t n) {
+    return set_batch(map, NULL, keys, keylens, values, n);
+}
+
+/*
+bhm_set_batch for keys whose hashes the caller has already computed, like bhm_set_hashed: the hash
+of keys[i] is hashes[i].
+*/
+bool
+bhm_set_batch_hashed(BHashMap *map, const uint64_t *hashes, const void *const *keys, const size_t *keylens, const void *const *values, const size_t n) {
+    pin_seed(map);
+
+    return set_batch(map, hashes, keys, keylens, values, n);
+}
+
+/*
+Grow the table of the map, if needed, so that it can hold "count" pairs in total without
+resizing. Never shrinks the table. An incremental resize in progress is completed.
+RETURN VALUE:
+    On success, true is returned.
+    On failure, false is returned and the map remains just as it was before the call.
+*/
+bool
+bhm_reserve(BHashMap *map, const size_t count) {
+    if (map->config.backend == BHM_BACKEND_SNAPSHOT) {
+        return false;
+    }
+
+    const size_t capacity_needed = capacity_for(map, count);
+
+    if (capacity_needed > map->capacity && !rebuild_table(map, capacity_needed)) {
+        return false;
+    }
+
+    /* the pairs the map was reserved for shouldn't have to pay for finishing the resize */
+    if (map->buckets_old) {
+        migrate_buckets(map, SIZE_MAX);
+    }
+
+    return true;
+}
+
+/*
+Move every pair (chaining) or out-of-line key copy (open addressing and dense) of the map into a
+fresh arena, packed next to each other in table order, and release the old arena along with the
+memory it held on to for pairs that have since been removed. If the fresh arena runs out of memory
+partway, the pairs moved so far stay where they are and the arenas are merged.
+*/
+static void
+compact_arena(BHashMap *map) {
+    if (map->config.allocator.allocate) {
+        return;
+    }
+
+    Arena fresh;
+    arena_init(&fresh);
+
+    bool ok = true;
+
+    if (map->config.backend == BHM_BACKEND_CHAINING) {
+        for (size_t i = 0; ok && i < map->capacity; i++) {
+            for (HashPair **link = &map->buckets[i]; *link; link = &(*link)->next) {
+                const size_t size = pair_size(map, (*link)->keylen);
+
+                HashPair *copy = arena_alloc(&fresh, size);
+                if (!copy) {
+                    ok = false;
+                    break;
+                }
+
+                memcpy(copy, *link, size);
+                arena_free(&map->arena, *link, size);
+                *link = copy;
+            }
+        }
+    } else if (!map->config.borrow_keys) {
+        Slot *slots = map->config.backend == BHM_BACKEND_DENSE ? map->entries : map->slots;
+        const size_t slot_count = map->config.backend == BHM_BACKEND_DENSE ? map->entry_count : map->capacity;
+
+        for (size_t i = 0; ok && i < slot_count; i++) {
+            Slot *slot = slot_at(map, slots, i);
+
+            const bool live = map->config.backend == BHM_BACKEND_DENSE ? slot->keylen != DENSE_ENTRY_REMOVED : map->ctrl[i] >= 0;
+
+            if (!live || slot->keylen <= SLOT_INLINE_KEY_MAX) {
+                continue;
+            }
+
+            unsigned char *copy = arena_alloc(&fresh, slot->keylen);
+            if (!copy) {
+                ok = false;
+                break;
+            }
+
+            memcpy(copy, slot->key.ptr, slot->keylen);
+            arena_free(&map->arena, (void *) slot->key.ptr, slot->keylen);
+            slot->key.ptr = copy;
+        }
+    }
+
+    if (!ok) {
+        arena_merge(&map->arena, &fresh);
+        return;
+    }
+
+    arena_release(&map->arena);
+    map->arena = fresh;
+}
+
+/*
+Shrink the map to the smallest table that holds its pairs without resizing, dropping the deleted
+slots of an open-addressed table and the removed entries of a dense map along the way. With the
+built-in arena, the pairs (or key copies) are also moved into fresh memory, packed together, and
+the memory left over by removed pairs is returned to the system.
+
+Pointers to keys obtained from the map before the call (e.g. through bhm_iterate) are invalidated.
+RETURN VALUE:
+    On success, true is returned.
+    On failure, false is returned and the map remains just as it was before the call.
+*/
+bool
+bhm_shrink_to_fit(BHashMap *map) {
+    if (map->config.backend == BHM_BACKEND_SNAPSHOT) {
+        return false;
+    }
+
+    if (map->buckets_old) {
+        migrate_buckets(map, SIZE_MAX);
+    }
+
+    const size_t capacity_fit = capacity_for(map, map->pair_count),
+                 capacity_new = capacity_fit < map->capacity ? capacity_fit : map->capacity;
+
+    /* even at the same capacity, a rebuild drops deleted slots and removed entries */
+    if (capacity_new < map->capacity || map->tombstone_count > 0 || map->entry_count > map->pair_count) {
+        if (!rebuild_table(map, capacity_new)) {
+            return false;
+        }
+
+        if (map->buckets_old) {
+            migrate_buckets(map, SIZE_MAX);
+        }
+    }
+
+    compact_arena(map);
+
+    return true;
+}
+
+/*
+Free every pair of a bucket array, leaving the array itself alone. Pairs living in the arena are
+not visited: they are freed all at once when the arena is released.
+*/
+static void
+free_chains(BHashMap *map, HashPair **buckets, const size_t bucket_count) {
+    for (size_t i = 0; map->config.allocator.allocate && i < bucket_count; i++)  {
+        HashPair *head = buckets[i];
+
+        while (head) {
+            HashPair *n = head->next;
+
+            map_free(map, head, pair_size(map, head->keylen));
+
+            head = n;
+        }
+    }
+}
+
+/*
+Remove every pair from the map. The table keeps its capacity and is reused as is, without being
+reallocated; only the memory of the pairs is freed.
+RETURN VALUE:
+    On success, true is returned.
+    On failure (the map is a read-only snapshot), false is returned.
+*/
+bool
+bhm_clear(BHashMap *map) {
+    switch (map->config.backend) {
+        case BHM_BACKEND_CHAINING:
+            free_chains(map, map->buckets, map->capacity);
+            memset(map->buckets, 0, map->capacity * sizeof(HashPair *));
+
+            if (map->buckets_old) {
+                free_buckets(map, map->buckets_old, map->capacity_old);
+
+                map->buckets_old = NULL;
+                map->capacity_old = 0;
+                map->migrate_idx = 0;
+            }
+
+            break;
+        case BHM_BACKEND_OPEN_ADDRESSING:
+            for (size_t i = 0; map->config.allocator.allocate && i < map->capacity; i++) {
+                if (map->ctrl[i] >= 0) {
+                    slot_free_key(map, slot_at(map, map->slots, i));
+                }
+            }
+
+            memset(map->ctrl, BHM_CTRL_EMPTY, map->capacity);
+            map->tombstone_count = 0;
+            break;
+        case BHM_BACKEND_DENSE:
+            for (size_t i = 0; map->config.allocator.allocate && i < map->entry_count; i++) {
+                if (slot_at(map, map->entries, i)->keylen != DENSE_ENTRY_REMOVED) {
+                    slot_free_key(map, slot_at(map, map->entries, i));
+                }
             }
 
-            insert_pair(new_pair, key, keylen, data);
+            memset(map->ctrl, BHM_CTRL_EMPTY, map->capacity);
+            map->tombstone_count = 0;
+            map->entry_count = 0;
+            break;
+        default:
+            return false;
+    }
+
+    arena_release(&map->arena);
+    map->pair_count = 0;
+
+    return true;
+}
+
+/*
+One of the threads of bhm_build. Every worker hashes a contiguous range of the keys, and (for a
+partitioned build) then inserts all keys whose bucket falls into its own range of buckets.
+*/
+typedef struct BuildWorker {
+    BHashMap *map;
+    const void *const *keys;
+    const size_t *keylens;
+    const void *const *values;
+    uint64_t *hashes;
+
+    /* indices of the keys, grouped by partition, in input order within each partition */
+    size_t *order;
+
+    size_t worker_count;
+
+    /* the keys hashed by this worker */
+    size_t key_start,
+           key_end;
+
+    /*
+    The number of keys of this worker that fall into each partition, and once those have been
+    counted, the position in "order" that the next of them goes to.
+    */
+    size_t partition_counts[BHM_BUILD_MAX_THREADS];
+
+    /* the positions in "order" of the keys of the partition filled by this worker */
+    size_t order_start,
+           order_end;
+
+    /* pairs are allocated from an arena per worker, and handed to the map once all are done */
+    Arena arena;
+    size_t pair_count;
+    bool failed;
+} BuildWorker;
+
+/*
+The partition of a key: its bucket, scaled down to the number of workers, so that every worker
+owns a contiguous range of buckets and no two workers ever touch the same chain.
+*/
+static inline size_t
+build_partition(const BuildWorker *worker, const uint64_t hash) {
+    const BHashMap *map = worker->map;
+
+    return bucket_index(map->config.indexing, hash, map->capacity) * worker->worker_count / map->capacity;
+}
+
+static void *
+build_hash(void *arg) {
+    BuildWorker *worker = arg;
+
+    for (size_t i = worker->key_start; i < worker->key_end; i++) {
+        worker->hashes[i] = hashing_hash(&worker->map->config, worker->keys[i], worker->keylens[i]);
+
+        if (worker->order) {
+            worker->partition_counts[build_partition(worker, worker->hashes[i])] += 1;
+        }
+    }
+
+    return NULL;
+}
+
+static void *
+build_scatter(void *arg) {
+    BuildWorker *worker = arg;
+
+    for (size_t i = worker->key_start; i < worker->key_end; i++) {
+        worker->order[worker->partition_counts[build_partition(worker, worker->hashes[i])]++] = i;
+    }
+
+    return NULL;
+}
+
+static void *
+build_fill(void *arg) {
+    BuildWorker *worker = arg;
+    BHashMap *map = worker->map;
+
+    for (size_t j = worker->order_start; j < worker->order_end; j++) {
+        const size_t i = worker->order[j];
+
+        HashPair **link = chain_find(map, worker->hashes[i], worker->keys[i], worker->keylens[i], NULL);
+
+        if (*link) {
+            /* a duplicate key: the last of its values wins, just as with bhm_set */
+            value_set(map, &(*link)->value, worker->values[i]);
+            continue;
+        }
+
+        HashPair *pair = arena_alloc(&worker->arena, pair_size(map, worker->keylens[i]));
+        if (!pair) {
+            worker->failed = true;
+            return NULL;
+        }
+
+        *pair = (HashPair) {
+            .keylen = worker->keylens[i],
+            .hash = worker->hashes[i]
+        };
+
+        insert_pair(map, pair, worker->keys[i], worker->keylens[i], worker->values[i]);
+
+        *link = pair;
+
+        worker->pair_count += 1;
+    }
+
+    return NULL;
+}
+
+/*
+Run "function" on every worker, each on a thread of its own, and wait for all of them to finish.
+The first worker runs on the calling thread.
+*/
+static void
+build_run(BuildWorker *workers, const size_t worker_count, void *(*function)(void *)) {
+    pthread_t threads[BHM_BUILD_MAX_THREADS];
+    bool started[BHM_BUILD_MAX_THREADS] = { false };
+
+    for (size_t i = 1; i < worker_count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, function, &workers[i]) == 0;
+
+        /* a worker that didn't get a thread of its own runs on this one */
+        if (!started[i]) {
+            function(&workers[i]);
+        }
+    }
+
+    function(&workers[0]);
+
+    for (size_t i = 1; i < worker_count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+/*
+Create a new BHashMap holding the "n" key-value pairs keys[i] and values[i], as if by creating an
+empty map with bhm_create and calling bhm_set for every pair in order.
+
+The table is sized for all the pairs up front, so it is never resized while the pairs are
+inserted. The keys are hashed in parallel on up to one thread per CPU. With the chaining backend
+and the built-in arena, the buckets are then split into one contiguous range per thread, the keys
+are grouped by the range their bucket falls into, and every thread inserts the keys of its own
+range without any locking. Other configurations insert the hashed keys on the calling thread.
+RETURN VALUE:
+    On success, return a pointer to the new BHashMap.
+    On failure, return NULL.
+*/
+BHashMap *
+bhm_build(const void *const *keys, const size_t *keylens, const void *const *values, const size_t n, const BHashMapConfig *config) {
+    BHashMap *map = bhm_create(0, config);
+    if (!map) {
+        return NULL;
+    }
+
+    const long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t worker_count = n / BHM_BUILD_MIN_KEYS_PER_THREAD;
+
+    if (cpu_count > 0 && worker_count > (size_t) cpu_count) {
+        worker_count = cpu_count;
+    }
+
+    if (worker_count > BHM_BUILD_MAX_THREADS) {
+        worker_count = BHM_BUILD_MAX_THREADS;
+    }
+
+    if (worker_count == 0) {
+        worker_count = 1;
+    }
+
+    /* pairs can only be allocated concurrently from arenas of their own */
+    const bool partitioned = worker_count > 1
+                          && map->config.backend == BHM_BACKEND_CHAINING
+                          && !map->config.allocator.allocate;
+
+    uint64_t *hashes = malloc(n * sizeof(uint64_t));
+    size_t *order = partitioned ? malloc(n * sizeof(size_t)) : NULL;
+    BuildWorker *workers = malloc(worker_count * sizeof(BuildWorker));
+
+    if ((n > 0 && !hashes) || (partitioned && !order) || !workers || !bhm_reserve(map, n)) {
+        free(hashes);
+        free(order);
+        free(workers);
+        bhm_destroy(map);
+        return NULL;
+    }
+
+    for (size_t w = 0; w < worker_count; w++) {
+        workers[w] = (BuildWorker) {
+            .map = map,
+            .keys = keys,
+            .keylens = keylens,
+            .values = values,
+            .hashes = hashes,
+            .order = order,
+            .worker_count = worker_count,
+            .key_start = n * w / worker_count,
+            .key_end = n * (w + 1) / worker_count
+        };
+
+        arena_init(&workers[w].arena);
+    }
+
+    build_run(workers, worker_count, build_hash);
 
-            head->next = new_pair;
+    bool ok = true;
 
-            map->pair_count += 1;
+    if (partitioned) {
+        /* lay the partitions out one after the other, and the keys of each worker within them */
+        size_t position = 0;
 
-            #ifdef BHM_DEBUG_BENCHMARK
-            uint64_t time_elapsed = end_benchmark(bench_start_nanos);
-            map->debug_benchmark_times.bhm_set_total_ms += time_elapsed;
-            #endif
+        for (size_t p = 0; p < worker_count; p++) {
+            workers[p].order_start = position;
 
-            if (get_load_factor(map) >= map->config.max_load_factor) {
-                resize(map);
+            for (size_t w = 0; w < worker_count; w++) {
+                const size_t count = workers[w].partition_counts[p];
+                workers[w].partition_counts[p] = position;
+                position += count;
             }
 
-            return true;
+            workers[p].order_end = position;
+        }
+
+        build_run(workers, worker_count, build_scatter);
+        build_run(workers, worker_count, build_fill);
+
+        for (size_t w = 0; w < worker_count; w++) {
+            arena_merge(&map->arena, &workers[w].arena);
+            map->pair_count += workers[w].pair_count;
+            ok &= !workers[w].failed;
         }
+    } else {
+        const uint64_t seed = map->config.seed;
+
+        /* once an insert has reseeded the hash function, the remaining keys are hashed again */
+        for (size_t i = 0; ok && i < n; i++) {
+            const uint64_t hash = map->config.seed == seed ? hashes[i] : hashing_hash(&map->config, keys[i], keylens[i]);
 
-        head = head->next;
+            ok = set_hashed(map, hash, keys[i], keylens[i], values[i]);
+        }
     }
 
-    #ifdef BHM_DEBUG_BENCHMARK
-    uint64_t time_elapsed = end_benchmark(bench_start_nanos);
-    map->debug_benchmark_times.bhm_set_total_ms += time_elapsed;
-    #endif
+    free(order);
+    free(hashes);
+    free(workers);
+
+    if (!ok) {
+        bhm_destroy(map);
+        return NULL;
+    }
 
-    return false; // ERROR ?
+    return map;
 }
 
 /*
-Get the value of a key from the map.
-RETURN VALUE:
-    NULL     - key not found / error
-    NON-NULL - appropriate data
+Free a bucket array along with its pairs.
 */
-void *
-bhm_get(const BHashMap *map, const void *key, const size_t keylen) {
-    #ifdef BHM_DEBUG_BENCHMARK
-    uint64_t bench_start_nanos = start_benchmark();
-    #endif
+static void
+free_buckets(BHashMap *map, HashPair **buckets, const size_t bucket_count) {
+    free_chains(map, buckets, bucket_count);
+    free(buckets);
+}
 
-    HashPair **bucket = find_bucket(map, key, keylen);
+/*
+Start a cursor over the pairs of shard "shard_idx" out of "shard_count" equal shards of the table.
+Every pair of the map is in exactly one shard, so cursors over all shards together visit every pair
+once, and can be advanced on different threads at the same time.
 
-    /* empty bucket, key definitely not in map */
-    if (bucket == NULL) {
-        return NULL;
+Shards are ranges of buckets (chaining), of groups of control bytes (open addressing and
+snapshots) or of entries (dense). While an incremental resize is in progress, every shard also covers its share of the
+buckets of the old bucket array that haven't been migrated yet.
+*/
+void
+bhm_iter_begin_range(const BHashMap *map, const size_t shard_idx, const size_t shard_count, BHashMapIterator *iter) {
+    *iter = (BHashMapIterator) {
+        .map = map
+    };
+
+    if (shard_idx >= shard_count) {
+        return;
     }
 
-    HashPair *head = *bucket;
+    if (map->config.backend == BHM_BACKEND_DENSE) {
+        iter->idx = map->entry_count * shard_idx / shard_count;
+        iter->end = map->entry_count * (shard_idx + 1) / shard_count;
+        return;
+    }
 
-    while (head) {
-        if (head->keylen == keylen && memcmp(key, head->key, keylen) == 0) {
-            return (void *) head->value;
-        }
+    if (map->config.backend != BHM_BACKEND_CHAINING) {
+        /* shards start and end on group boundaries, so the cursor can scan whole groups */
+        const size_t group_count = map->capacity / BHM_CTRL_GROUP_WIDTH;
 
-        head = head->next;
+        iter->idx = group_count * shard_idx / shard_count * BHM_CTRL_GROUP_WIDTH;
+        iter->end = group_count * (shard_idx + 1) / shard_count * BHM_CTRL_GROUP_WIDTH;
+        return;
     }
 
-    #ifdef BHM_DEBUG_BENCHMARK
-    uint64_t time_elapsed = end_benchmark(bench_start_nanos);
-    ((BHashMap*) map)->debug_benchmark_times.bhm_get_total_ms += time_elapsed;
-    #endif
+    iter->idx = map->capacity * shard_idx / shard_count;
+    iter->end = map->capacity * (shard_idx + 1) / shard_count;
 
-    return NULL;
+    if (map->buckets_old) {
+        iter->old_idx = map->capacity_old * shard_idx / shard_count;
+        iter->old_end = map->capacity_old * (shard_idx + 1) / shard_count;
+
+        /* buckets below migrate_idx have already been moved to the current bucket array */
+        if (iter->old_idx < map->migrate_idx) {
+            iter->old_idx = map->migrate_idx;
+        }
+    }
 }
 
-/* remove a key from the hash map */
+/*
+Start a cursor over all pairs of the map. The map must not be modified while the cursor is in use.
+*/
+void
+bhm_iter_begin(const BHashMap *map, BHashMapIterator *iter) {
+    bhm_iter_begin_range(map, 0, 1, iter);
+}
+
+/*
+Advance a cursor to the next pair of the map, storing its key, key length and value in "key",
+"keylen" and "value".
+
+Empty slots of an open-addressed table or a snapshot are skipped a whole group of control bytes at
+a time. The chained table is scanned bucket by bucket, and the entries of a dense map are scanned
+in insertion order.
+RETURN VALUE:
+    If the cursor was advanced to a pair, true is returned.
+    If there are no more pairs, false is returned.
+*/
 bool
-bhm_remove(BHashMap *map, const void *key, const size_t keylen) {
-    HashPair **bucket = find_bucket(map, key, keylen);
+bhm_iter_next(BHashMapIterator *iter, const void **key, size_t *keylen, void **value) {
+    const BHashMap *map = iter->map;
 
-    /* head bucket empty - key definitely not in map */
-    if (bucket == NULL) {
-        return false;
-    }
+    if (map->config.backend == BHM_BACKEND_DENSE) {
+        while (iter->idx < iter->end && slot_at(map, map->entries, iter->idx)->keylen == DENSE_ENTRY_REMOVED) {
+            iter->idx += 1;
+        }
+
+        if (iter->idx >= iter->end) {
+            return false;
+        }
 
-    /* head bucket has at least one pair */
-    HashPair *head = *bucket;
+        const Slot *entry = slot_at(map, map->entries, iter->idx++);
+
+        *key = slot_key(entry);
+        *keylen = entry->keylen;
+        *value = value_get(map, &entry->value);
 
-    /* if it's the ONLY pair and it's the right key */
-    if (head->next == NULL && head->keylen == keylen && memcmp(head->key, key, keylen) == 0) {
-        free(head);
-        *bucket = NULL;
         return true;
     }
 
-    while (head && head->next) {
-        HashPair *next = head->next;
+    if (map->config.backend != BHM_BACKEND_CHAINING) {
+        const int8_t *ctrl = map->config.backend == BHM_BACKEND_SNAPSHOT ? map->snapshot.ctrl : map->ctrl;
 
-        if (next->keylen == keylen && memcmp(key, next->key, keylen) == 0) {
-            HashPair *nn = next->next;
-            free(next);
-            head->next = nn;
+        /* "mask" holds the full slots of the group before "idx" that haven't been visited yet */
+        while (!iter->mask) {
+            if (iter->idx >= iter->end) {
+                return false;
+            }
 
-            return true;
+            iter->mask = bhm_ctrl_group_match_full(&ctrl[iter->idx]);
+            iter->idx += BHM_CTRL_GROUP_WIDTH;
         }
 
-        head = next;
-    }
+        const size_t slot_idx = iter->idx - BHM_CTRL_GROUP_WIDTH + BHM_CTRL_MASK_FIRST(iter->mask);
+        iter->mask &= iter->mask - 1;
 
-    return false;
-}
+        if (map->config.backend == BHM_BACKEND_SNAPSHOT) {
+            const SnapshotSlot *slot = &map->snapshot.slots[slot_idx];
 
-static void
-free_buckets(HashPair **buckets, const size_t bucket_count) {
-    for (size_t i = 0; i < bucket_count; i++)  {
-        HashPair *head = buckets[i];
+            *key = snapshot_slot_key(&map->snapshot, slot);
+            *keylen = slot->keylen;
+            *value = snapshot_slot_value(&map->snapshot, slot);
+        } else {
+            const Slot *slot = slot_at(map, map->slots, slot_idx);
 
-        while (head) {
-            HashPair *n = head->next;
+            *key = slot_key(slot);
+            *keylen = slot->keylen;
+            *value = value_get(map, &slot->value);
+        }
+
+        return true;
+    }
 
-            free(head);
+    const HashPair *pair = iter->pair;
 
-            head = n;
+    while (!pair) {
+        if (iter->idx < iter->end) {
+            pair = map->buckets[iter->idx++];
+        } else if (iter->old_idx < iter->old_end) {
+            /* pairs not yet migrated by an incremental resize in progress */
+            pair = map->buckets_old[iter->old_idx++];
+        } else {
+            return false;
         }
     }
 
-    free(buckets);
+    iter->pair = pair->next;
+
+    *key = pair_key(map, pair);
+    *keylen = pair->keylen;
+    *value = value_get(map, &pair->value);
+
+    return true;
 }
 
 /*
@@ -454,18 +2762,57 @@ the length of the key, and a pointer to the value.
 */
 void
 bhm_iterate(const BHashMap *map, bhm_iterator_callback callback_function) {
-    for (size_t i = 0; i < map->capacity; i++) {
-        HashPair *head = map->buckets[i];
+    BHashMapIterator iter;
+    const void *key;
+    size_t keylen;
+    void *value;
 
-        if (head == NULL) {
-            continue;
-        }
+    bhm_iter_begin(map, &iter);
 
-        while (head) {
-            callback_function(head->key, head->keylen, (void *) head->value);
-            head = head->next;
+    while (bhm_iter_next(&iter, &key, &keylen, &value)) {
+        callback_function(key, keylen, value);
+    }
+}
+
+/*
+For each pair in shard "shard_idx" out of "shard_count" shards of the map (see
+bhm_iter_begin_range), call the passed in callback function with the key, the length of the key,
+the value and "ctx". Iteration stops early as soon as the callback returns false.
+
+Different shards of a map can be iterated on different threads at the same time, as long as
+nothing modifies the map meanwhile.
+RETURN VALUE:
+    If every pair of the shard was visited, true is returned.
+    If the callback stopped the iteration, false is returned.
+*/
+bool
+bhm_iterate_range(const BHashMap *map, const size_t shard_idx, const size_t shard_count, bhm_iterator_callback_ctx callback_function, void *ctx) {
+    BHashMapIterator iter;
+    const void *key;
+    size_t keylen;
+    void *value;
+
+    bhm_iter_begin_range(map, shard_idx, shard_count, &iter);
+
+    while (bhm_iter_next(&iter, &key, &keylen, &value)) {
+        if (!callback_function(key, keylen, value, ctx)) {
+            return false;
         }
     }
+
+    return true;
+}
+
+/*
+For each pair in the map, call the passed in callback function with the key, the length of the
+key, the value and "ctx". Iteration stops early as soon as the callback returns false.
+RETURN VALUE:
+    If every pair was visited, true is returned.
+    If the callback stopped the iteration, false is returned.
+*/
+bool
+bhm_iterate_ctx(const BHashMap *map, bhm_iterator_callback_ctx callback_function, void *ctx) {
+    return bhm_iterate_range(map, 0, 1, callback_function, ctx);
 }
 
 /*
@@ -484,34 +2831,396 @@ bhm_get_config(const BHashMap *map) {
     return map->config;
 }
 
+/* record a pair found after "length" probes */
+static inline void
+stats_add_probe(BHashMapStats *stats, const size_t length, uint64_t *probe_total) {
+    stats->probe_length_histogram[length <= BHM_STATS_HISTOGRAM_SIZE ? length - 1 : BHM_STATS_HISTOGRAM_SIZE - 1] += 1;
+    *probe_total += length;
+
+    if (length > stats->max_probe_length) {
+        stats->max_probe_length = length;
+    }
+}
+
+/* record the out-of-line key copy of a slot or dense entry, if it has one */
+static inline void
+stats_add_slot_key(const BHashMap *map, BHashMapStats *stats, const Slot *slot) {
+    if (slot->keylen > SLOT_INLINE_KEY_MAX && !map->config.borrow_keys) {
+        stats->key_bytes += slot->keylen;
+    }
+}
+
+/* record the chains of buckets[start, end) */
+static void
+stats_add_chains(const BHashMap *map, BHashMapStats *stats, HashPair *const *buckets, const size_t start, const size_t end, uint64_t *probe_total) {
+    for (size_t i = start; i < end; i++) {
+        size_t length = 0;
+
+        for (const HashPair *pair = buckets[i]; pair; pair = pair->next) {
+            const size_t key_bytes = map->config.borrow_keys ? 0 : pair->keylen;
+
+            length += 1;
+            stats_add_probe(stats, length, probe_total);
+
+            stats->node_bytes += pair_size(map, pair->keylen) - key_bytes;
+            stats->key_bytes += key_bytes;
+        }
+
+        stats->chain_length_histogram[length < BHM_STATS_HISTOGRAM_SIZE ? length : BHM_STATS_HISTOGRAM_SIZE - 1] += 1;
+    }
+}
+
+/*
+Fill in "stats" with the shape, memory use and history of the map. The histograms and probe
+lengths take a pass over the whole table. During an incremental resize, the buckets of the old
+array that haven't been migrated yet are counted as chains of their own.
+*/
+void
+bhm_get_stats(const BHashMap *map, BHashMapStats *stats) {
+    *stats = (BHashMapStats) {
+        .backend = map->config.backend,
+        .capacity = map->capacity,
+        .count = map->pair_count,
+        .load_factor = get_load_factor(map),
+        .tombstone_count = map->config.backend == BHM_BACKEND_DENSE ? map->entry_count - map->pair_count : map->tombstone_count,
+        .arena_bytes = map->arena.bytes_reserved,
+        .resize_count = map->resize_count,
+        .resize_ns = map->resize_ns,
+        .reseed_count = map->reseed_count,
+        .counters_enabled = map->counters_enabled,
+        .operation_count = map->operation_count,
+        .hit_count = map->hit_count,
+        .miss_count = map->miss_count,
+        .probe_count = map->probe_count
+    };
+
+    uint64_t probe_total = 0;
+
+    switch (map->config.backend) {
+        case BHM_BACKEND_CHAINING:
+            stats->table_bytes = (map->capacity + map->capacity_old) * sizeof(HashPair *);
+
+            stats_add_chains(map, stats, map->buckets, 0, map->capacity, &probe_total);
+
+            if (map->buckets_old) {
+                stats_add_chains(map, stats, map->buckets_old, map->migrate_idx, map->capacity_old, &probe_total);
+            }
+
+            break;
+        case BHM_BACKEND_OPEN_ADDRESSING:
+            stats->table_bytes = map->capacity * (sizeof(int8_t) + map->slot_size);
+
+            for (size_t i = 0; i < map->capacity; i++) {
+                if (map->ctrl[i] >= 0) {
+                    const Slot *slot = slot_at(map, map->slots, i);
+
+                    stats_add_probe(stats, probe_groups(map->ctrl, map->capacity, slot->hash, i), &probe_total);
+                    stats_add_slot_key(map, stats, slot);
+                }
+            }
+
+            break;
+        case BHM_BACKEND_DENSE:
+            stats->table_bytes = map->capacity * (sizeof(int8_t) + sizeof(uint32_t)) + map->entry_capacity * map->slot_size;
+
+            for (size_t i = 0; i < map->capacity; i++) {
+                if (map->ctrl[i] >= 0) {
+                    const Slot *entry = slot_at(map, map->entries, map->indices[i]);
+
+                    stats_add_probe(stats, probe_groups(map->ctrl, map->capacity, entry->hash, i), &probe_total);
+                    stats_add_slot_key(map, stats, entry);
+                }
+            }
+
+            break;
+        case BHM_BACKEND_SNAPSHOT:
+            /* the keys are part of the mapped file */
+            stats->table_bytes = map->snapshot.size;
+
+            for (size_t i = 0; i < map->capacity; i++) {
+                if (map->snapshot.ctrl[i] >= 0) {
+                    stats_add_probe(stats, probe_groups(map->snapshot.ctrl, map->capacity, map->snapshot.slots[i].hash, i), &probe_total);
+                }
+            }
+
+            break;
+    }
+
+    stats->mean_probe_length = map->pair_count > 0 ? (double) probe_total / (double) map->pair_count : 0;
+}
+
+/*
+Start or stop counting the operations on the map for bhm_get_stats, resetting the counters when
+starting. While the counters are enabled, every bhm_set, bhm_get and bhm_remove (and their batch
+and integer variants, bhm_get_or_insert and bhm_upsert) walks the probe sequence of its key a
+second time to measure it, and lookups write to the map, so they must not run concurrently.
+*/
+void
+bhm_enable_counters(BHashMap *map, const bool enabled) {
+    if (enabled) {
+        map->operation_count = 0;
+        map->hit_count = 0;
+        map->miss_count = 0;
+        map->probe_count = 0;
+    }
+
+    map->counters_enabled = enabled;
+}
+
+/*
+Start recording the latency of every "sample_interval"-th bhm_get, bhm_set and bhm_remove (and
+their integer variants) and of every rebuild of the table, or stop recording if "sample_interval"
+is 0. Starting discards whatever was recorded before. Batch operations aren't recorded, and
+bhm_get_or_insert and bhm_upsert are recorded as sets.
+RETURN VALUE:
+    On success, true is returned.
+    On failure, false is returned and the map records no latencies.
+*/
+bool
+bhm_enable_latency(BHashMap *map, const size_t sample_interval) {
+    free(map->latency);
+    map->latency = NULL;
+
+    if (sample_interval == 0) {
+        return true;
+    }
+
+    map->latency = malloc(BHM_OPERATION_COUNT * sizeof(Histogram));
+    if (!map->latency) {
+        return false;
+    }
+
+    for (size_t operation = 0; operation < BHM_OPERATION_COUNT; operation++) {
+        histogram_init(&map->latency[operation]);
+    }
+
+    map->latency_sample_interval = sample_interval;
+    map->latency_countdown = sample_interval;
+
+    return true;
+}
+
+/*
+Summarize the latencies recorded for an operation.
+RETURN VALUE:
+    If latency recording is enabled, true is returned.
+    Otherwise, false is returned and "latency" is left alone.
+*/
+bool
+bhm_get_latency(const BHashMap *map, const BHashMapOperation operation, BHashMapLatency *latency) {
+    if (!map->latency || operation >= BHM_OPERATION_COUNT) {
+        return false;
+    }
+
+    const Histogram *histogram = &map->latency[operation];
+
+    *latency = (BHashMapLatency) {
+        .count = histogram->count,
+        .min_ns = histogram->min,
+        .max_ns = histogram->max,
+        .p50_ns = histogram_percentile(histogram, 50),
+        .p90_ns = histogram_percentile(histogram, 90),
+        .p99_ns = histogram_percentile(histogram, 99),
+        .p999_ns = histogram_percentile(histogram, 99.9),
+        .mean_ns = histogram->count > 0 ? (double) histogram->total / (double) histogram->count : 0
+    };
+
+    return true;
+}
+
+/*
+Return the latency in nanoseconds below or at which "percentile" percent (0 to 100) of the recorded
+operations of a kind completed, or 0 if latency recording is disabled or none were recorded.
+*/
+uint64_t
+bhm_latency_percentile(const BHashMap *map, const BHashMapOperation operation, const double percentile) {
+    if (!map->latency || operation >= BHM_OPERATION_COUNT) {
+        return 0;
+    }
+
+    return histogram_percentile(&map->latency[operation], percentile);
+}
+
+/*
+Write a snapshot of the map to the file at "path", to be mapped back in by bhm_open_mmap.
+
+If "value_size" is 0, the value pointers themselves are stored, which is only meaningful for
+values that aren't pointers into memory of this process, such as integers cast to pointers.
+Otherwise "value_size" bytes are copied from where each value points to and the values of the
+opened snapshot point into the file. The values of a map with inline values (see value_size in
+BHashMapConfig) are always copied, with the map's own value_size, and "value_size" is ignored.
+
+Only maps using a built-in hash function can be saved: a function pointer cannot be stored in
+the file. The seed is stored along with the hash function.
+RETURN VALUE:
+    On success, true is returned.
+    On failure, false is returned.
+*/
+bool
+bhm_save(const BHashMap *map, const char *path, const size_t value_size) {
+    if (map->config.builtin_hash == BHM_HASH_DEFAULT) {
+        return false;
+    }
+
+    const size_t stored_value_size = map->config.value_size > 0 ? map->config.value_size : value_size;
+
+    const double max_load_factor = map->config.max_load_factor < BHM_OPEN_LOAD_FACTOR_LIMIT
+                                 ? map->config.max_load_factor
+                                 : BHM_OPEN_LOAD_FACTOR_LIMIT;
+
+    SnapshotWriter writer;
+    if (!snapshot_writer_init(&writer, map->pair_count, map->config.builtin_hash, map->config.seed, max_load_factor, stored_value_size)) {
+        return false;
+    }
+
+    bool ok = true;
+
+    if (map->config.backend == BHM_BACKEND_OPEN_ADDRESSING) {
+        for (size_t i = 0; ok && i < map->capacity; i++) {
+            if (map->ctrl[i] >= 0) {
+                const Slot *slot = slot_at(map, map->slots, i);
+                ok = snapshot_writer_add(&writer, slot->hash, slot_key(slot), slot->keylen, value_get(map, &slot->value));
+            }
+        }
+    } else if (map->config.backend == BHM_BACKEND_DENSE) {
+        for (size_t i = 0; ok && i < map->entry_count; i++) {
+            const Slot *entry = slot_at(map, map->entries, i);
+
+            if (entry->keylen != DENSE_ENTRY_REMOVED) {
+                ok = snapshot_writer_add(&writer, entry->hash, slot_key(entry), entry->keylen, value_get(map, &entry->value));
+            }
+        }
+    } else if (map->config.backend == BHM_BACKEND_SNAPSHOT) {
+        for (size_t i = 0; ok && i < map->capacity; i++) {
+            if (map->snapshot.ctrl[i] >= 0) {
+                const SnapshotSlot *slot = &map->snapshot.slots[i];
+                ok = snapshot_writer_add(&writer, slot->hash, snapshot_slot_key(&map->snapshot, slot), slot->keylen, snapshot_slot_value(&map->snapshot, slot));
+            }
+        }
+    } else {
+        for (size_t i = 0; ok && i < map->capacity; i++) {
+            for (HashPair *pair = map->buckets[i]; ok && pair; pair = pair->next) {
+                ok = snapshot_writer_add(&writer, pair->hash, pair_key(map, pair), pair->keylen, value_get(map, &pair->value));
+            }
+        }
+
+        /* pairs not yet migrated by an incremental resize in progress */
+        for (size_t i = map->migrate_idx; ok && map->buckets_old && i < map->capacity_old; i++) {
+            for (HashPair *pair = map->buckets_old[i]; ok && pair; pair = pair->next) {
+                ok = snapshot_writer_add(&writer, pair->hash, pair_key(map, pair), pair->keylen, value_get(map, &pair->value));
+            }
+        }
+    }
+
+    if (!ok) {
+        snapshot_writer_discard(&writer);
+        return false;
+    }
+
+    return snapshot_writer_finish(&writer, path);
+}
+
+/*
+Open a snapshot written by bhm_save as a read-only map. The file is mapped into memory and
+queried in place, so opening it costs the same regardless of its size: pages of the table are
+only read in from the file as lookups touch them.
+
+The map uses the hash function, seed and load factor recorded in the snapshot. bhm_set and
+bhm_remove fail on it; bhm_get, bhm_iterate and the other read-only functions work as usual.
+bhm_destroy unmaps the file.
+RETURN VALUE:
+    On success, return a pointer to the new BHashMap.
+    On failure (including a file that isn't a snapshot compatible with this build), return NULL.
+*/
+BHashMap *
+bhm_open_mmap(const char *path) {
+    BHashMap *map = malloc(sizeof(BHashMap));
+
+    if (!map) {
+        return NULL;
+    }
+
+    *map = (BHashMap) { 0 };
+
+    atomic_init(&map->seed_pinned, false);
+
+    if (!snapshot_open(&map->snapshot, path)) {
+        free(map);
+        return NULL;
+    }
+
+    const SnapshotHeader *header = map->snapshot.header;
+
+    if (header->builtin_hash != BHM_HASH_WYHASH && header->builtin_hash != BHM_HASH_MURMUR3) {
+        snapshot_close(&map->snapshot);
+        free(map);
+        return NULL;
+    }
+
+    const BHashMapConfig config_user = {
+        .builtin_hash = header->builtin_hash,
+        .seed = header->seed
+    };
+
+    /* values copied into the file are returned in place, just like inline values */
+    map->config = (BHashMapConfig) {
+        .max_load_factor = header->max_load_factor,
+        .resize_growth_factor = BHM_DEFAULT_RESIZE_GROWTH_FACTOR,
+        .backend = BHM_BACKEND_SNAPSHOT,
+        .indexing = BHM_INDEXING_POW2,
+        .value_size = header->value_size
+    };
+
+    hashing_resolve_config(&map->config, &config_user);
+
+    map->capacity = header->capacity;
+    map->pair_count = header->count;
+
+    arena_init(&map->arena);
+
+    return map;
+}
+
 /*
 Free all resources occupied by the hash map. This includes the memory of the main BHashMap
 structure, the memory for all the hash pairs in the structure (those at the 'root' as well as 
 those in the linked lists), as well as memory for all the copied keys.
+
+With the built-in arena, pairs and keys are freed slab by slab instead of one at a time.
 */
 void
 bhm_destroy(BHashMap *map) {
-    #ifdef BHM_DEBUG_BENCHMARK
-    uint64_t bench_start_nanos = start_benchmark();
-    #endif
-
-    free_buckets(map->buckets, map->capacity);
-
-    #ifdef BHM_DEBUG_BENCHMARK
-    uint64_t time_elapsed = end_benchmark(bench_start_nanos);
-    fprintf(
-        stderr,
-        "\e[1;93mbhm_destroy:\e[0m total time spent in functions of this instance:\n"
-        "\t\e[1;93mbhm_resize\e[0m:\e[92m%lums\e[0m\n"
-        "\t\e[1;93mbhm_get\e[0m:\e[92m%lums\e[0m\n"
-        "\t\e[1;93mbhm_set\e[0m:\e[92m%lums\e[0m\n"
-        "\t\e[1;93mbhm_destroy\e[0m:\e[92m%lums\e[0m\n",
-        map->debug_benchmark_times.bhm_resize_total_ms,
-        map->debug_benchmark_times.bhm_get_total_ms,
-        map->debug_benchmark_times.bhm_set_total_ms,
-        time_elapsed
-    );
-    #endif
+    if (map->config.backend == BHM_BACKEND_OPEN_ADDRESSING) {
+        for (size_t i = 0; map->config.allocator.allocate && i < map->capacity; i++) {
+            if (map->ctrl[i] >= 0) {
+                slot_free_key(map, slot_at(map, map->slots, i));
+            }
+        }
+
+        free(map->ctrl);
+        free(map->slots);
+    } else if (map->config.backend == BHM_BACKEND_DENSE) {
+        for (size_t i = 0; map->config.allocator.allocate && i < map->entry_count; i++) {
+            if (slot_at(map, map->entries, i)->keylen != DENSE_ENTRY_REMOVED) {
+                slot_free_key(map, slot_at(map, map->entries, i));
+            }
+        }
+
+        free(map->ctrl);
+        free(map->indices);
+        free(map->entries);
+    } else if (map->config.backend == BHM_BACKEND_SNAPSHOT) {
+        snapshot_close(&map->snapshot);
+    } else {
+        free_buckets(map, map->buckets, map->capacity);
+
+        if (map->buckets_old) {
+            free_buckets(map, map->buckets_old, map->capacity_old);
+        }
+    }
+
+    arena_release(&map->arena);
+    free(map->latency);
 
     free(map);
 }
@@ -0,0 +1,669 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/types.h>
+
+#include "bhashmap_concurrent.h"
+#include "hashing.h"
+
+/*
+A thread safe hash map with separate chaining.
+
+* Readers (bhm_concurrent_get) never take a lock. Chains are only ever modified by atomically
+  swinging a single pointer, so a reader always observes a consistent chain, and memory that is
+  unlinked from the map is only freed once every reader that may still see it has finished. This
+  is tracked RCU-style: readers announce themselves in one of two per-epoch counters, and a
+  writer that wants to free memory flips the epoch twice, each time waiting for the readers
+  counted under the previous epoch to drain.
+
+* Writers lock one of BHM_CONCURRENT_STRIPES stripes. Bucket counts are powers of two no smaller
+  than the stripe count, so the stripe of a key depends only on its hash, and is the same in every
+  bucket array the map will ever have.
+
+* Resizing never stops the world. The old bucket array gets a pointer to the new one, and its
+  stripes are then migrated one at a time under their own locks, by the writer that started the
+  resize as well as by any other writer that comes along while it is in progress. Each migrated
+  bucket is replaced by a forwarding marker which sends readers and writers on to the new array.
+  Pairs are copied rather than relinked, so readers still walking an old chain are unaffected.
+*/
+
+#define BHM_CONCURRENT_DEFAULT_INITIAL_CAPACITY 1024
+#define BHM_CONCURRENT_DEFAULT_MAX_LOAD_FACTOR 0.75
+#define BHM_CONCURRENT_STRIPES 64
+#define BHM_CONCURRENT_READER_SLOTS 64
+#define BHM_CONCURRENT_RECLAIM_THRESHOLD 256
+
+#define CACHE_LINE 64
+
+typedef struct CNode {
+    _Atomic(struct CNode *) next;
+    _Atomic(const void *) value;
+    /* link of the list of retired nodes awaiting reclamation; "next" must stay intact for readers */
+    struct CNode *retired_next;
+    uint64_t hash;
+    size_t keylen;
+    unsigned char key[];
+} CNode;
+
+typedef struct CTable {
+    size_t capacity;
+    /* the table this one is being migrated to, set before the first bucket is forwarded */
+    _Atomic(struct CTable *) next;
+    /*
+    The next stripe to claim and the count of migrated stripes of the migration to "next". They
+    live in the table rather than the map, so that a helper that is late to a finished resize
+    finds nothing left to claim instead of claiming a stripe of a later resize.
+    */
+    atomic_size_t migrate_next_stripe,
+                  migrate_done_stripes;
+    struct CTable *retired_next;
+    _Atomic(CNode *) buckets[];
+} CTable;
+
+typedef struct Stripe {
+    _Alignas(CACHE_LINE) pthread_mutex_t lock;
+} Stripe;
+
+typedef struct ReaderSlot {
+    _Alignas(CACHE_LINE) atomic_size_t count[2];
+} ReaderSlot;
+
+struct BHashMapConcurrent {
+    BHashMapConfig config;
+
+    _Atomic(CTable *) table;
+    atomic_size_t pair_count;
+
+    /* the table being migrated while a resize is in progress, NULL otherwise */
+    _Atomic(CTable *) resize_from;
+    atomic_flag resizing;
+
+    Stripe stripes[BHM_CONCURRENT_STRIPES];
+
+    /* reclamation */
+    ReaderSlot readers[BHM_CONCURRENT_READER_SLOTS];
+    _Alignas(CACHE_LINE) atomic_uint_fast64_t epoch;
+    pthread_mutex_t grace_period_lock,
+                    retire_lock;
+    CNode *retired_nodes;
+    CTable *retired_tables;
+    atomic_size_t retired_count;
+};
+
+/* marker stored in the buckets of a table that have been migrated to its successor */
+static CNode forwarded_marker;
+#define FORWARDED (&forwarded_marker)
+
+static atomic_uint reader_slot_counter;
+static _Thread_local int reader_slot = -1;
+static _Thread_local unsigned read_depth;
+
+/*
+Enter a read-side critical section: nothing reachable from the map will be freed until the
+matching read_unlock. Returns the counter to pass to read_unlock.
+*/
+static inline atomic_size_t *
+read_lock(BHashMapConcurrent *map) {
+    if (reader_slot < 0) {
+        reader_slot = atomic_fetch_add_explicit(&reader_slot_counter, 1, memory_order_relaxed) % BHM_CONCURRENT_READER_SLOTS;
+    }
+
+    const uint_fast64_t epoch = atomic_load(&map->epoch);
+    atomic_size_t *counter = &map->readers[reader_slot].count[epoch & 1];
+
+    atomic_fetch_add(counter, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    read_depth += 1;
+
+    return counter;
+}
+
+static inline void
+read_unlock(atomic_size_t *counter) {
+    read_depth -= 1;
+    atomic_fetch_sub_explicit(counter, 1, memory_order_release);
+}
+
+/*
+Wait until every read-side critical section that was entered before the call has been left.
+*/
+static void
+synchronize(BHashMapConcurrent *map) {
+    atomic_thread_fence(memory_order_seq_cst);
+
+    /*
+    A reader may have sampled the epoch right before a flip and only then incremented the counter
+    of the old epoch, where a single flip would not wait for it. After two flips, both counters
+    have been drained once since the call started.
+    */
+    for (int flip = 0; flip < 2; flip++) {
+        const uint_fast64_t old_epoch = atomic_fetch_add(&map->epoch, 1);
+
+        for (size_t i = 0; i < BHM_CONCURRENT_READER_SLOTS; i++) {
+            while (atomic_load(&map->readers[i].count[old_epoch & 1]) != 0) {
+                sched_yield();
+            }
+        }
+    }
+}
+
+static void
+free_retired(CNode *nodes, CTable *tables) {
+    while (nodes) {
+        CNode *n = nodes->retired_next;
+        free(nodes);
+        nodes = n;
+    }
+
+    while (tables) {
+        CTable *n = tables->retired_next;
+        free(tables);
+        tables = n;
+    }
+}
+
+/*
+Free retired memory if enough of it has piled up. Must be called outside of a read-side critical
+section, and without holding a stripe lock.
+*/
+static void
+reclaim(BHashMapConcurrent *map) {
+    if (read_depth > 0) {
+        return;
+    }
+
+    if (atomic_load_explicit(&map->retired_count, memory_order_relaxed) < BHM_CONCURRENT_RECLAIM_THRESHOLD) {
+        return;
+    }
+
+    /* one reclaimer at a time is enough, the others just carry on */
+    if (pthread_mutex_trylock(&map->grace_period_lock) != 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&map->retire_lock);
+    CNode *nodes = map->retired_nodes;
+    CTable *tables = map->retired_tables;
+    map->retired_nodes = NULL;
+    map->retired_tables = NULL;
+    atomic_store_explicit(&map->retired_count, 0, memory_order_relaxed);
+    pthread_mutex_unlock(&map->retire_lock);
+
+    synchronize(map);
+    free_retired(nodes, tables);
+
+    pthread_mutex_unlock(&map->grace_period_lock);
+}
+
+/*
+Queue a list of unlinked nodes, chained through "retired_next", to be freed once no reader can
+see them anymore.
+*/
+static void
+retire_nodes(BHashMapConcurrent *map, CNode *first, CNode *last, const size_t count) {
+    pthread_mutex_lock(&map->retire_lock);
+    last->retired_next = map->retired_nodes;
+    map->retired_nodes = first;
+    atomic_fetch_add_explicit(&map->retired_count, count, memory_order_relaxed);
+    pthread_mutex_unlock(&map->retire_lock);
+}
+
+static void
+retire_table(BHashMapConcurrent *map, CTable *table) {
+    pthread_mutex_lock(&map->retire_lock);
+    table->retired_next = map->retired_tables;
+    map->retired_tables = table;
+    atomic_fetch_add_explicit(&map->retired_count, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&map->retire_lock);
+}
+
+static CTable *
+create_table(const size_t capacity) {
+    CTable *table = malloc(sizeof(CTable) + capacity * sizeof(_Atomic(CNode *)));
+    if (!table) {
+        return NULL;
+    }
+
+    table->capacity = capacity;
+    table->retired_next = NULL;
+    atomic_init(&table->next, NULL);
+    atomic_init(&table->migrate_next_stripe, 0);
+    atomic_init(&table->migrate_done_stripes, 0);
+
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&table->buckets[i], NULL);
+    }
+
+    return table;
+}
+
+static CNode *
+create_node(const uint64_t hash, const void *key, const size_t keylen, const void *data) {
+    CNode *node = malloc(sizeof(CNode) + keylen);
+    if (!node) {
+        return NULL;
+    }
+
+    node->hash = hash;
+    node->keylen = keylen;
+    node->retired_next = NULL;
+    atomic_init(&node->next, NULL);
+    atomic_init(&node->value, data);
+    memcpy(node->key, key, keylen);
+
+    return node;
+}
+
+static inline bool
+node_matches(const CNode *node, const uint64_t hash, const void *key, const size_t keylen) {
+    return node->hash == hash && node->keylen == keylen && memcmp(key, node->key, keylen) == 0;
+}
+
+static inline size_t
+stripe_of(const uint64_t hash) {
+    return hash & (BHM_CONCURRENT_STRIPES - 1);
+}
+
+/*
+Return the bucket a hash lives in, following forwarding markers to the newest table that holds
+it. The caller must either hold the stripe lock of the hash, or be prepared for the returned
+bucket to be forwarded at any time.
+*/
+static inline _Atomic(CNode *) *
+current_bucket(BHashMapConcurrent *map, const uint64_t hash) {
+    CTable *table = atomic_load_explicit(&map->table, memory_order_acquire);
+    _Atomic(CNode *) *bucket = &table->buckets[hash & (table->capacity - 1)];
+
+    while (atomic_load_explicit(bucket, memory_order_acquire) == FORWARDED) {
+        table = atomic_load_explicit(&table->next, memory_order_acquire);
+        bucket = &table->buckets[hash & (table->capacity - 1)];
+    }
+
+    return bucket;
+}
+
+/*
+Migrate all buckets of one stripe of "from" to its successor table.
+*/
+static bool
+migrate_stripe(BHashMapConcurrent *map, CTable *from, const size_t stripe) {
+    CTable *to = atomic_load_explicit(&from->next, memory_order_acquire);
+    bool ok = true;
+
+    pthread_mutex_lock(&map->stripes[stripe].lock);
+
+    for (size_t b = stripe; b < from->capacity; b += BHM_CONCURRENT_STRIPES) {
+        CNode *head = atomic_load_explicit(&from->buckets[b], memory_order_acquire);
+
+        /*
+        Only this stripe's buckets of "to" receive pairs from bucket b, and no writer reaches them
+        before b is forwarded, so they can be filled with plain stores. Build the copies first and
+        only retire the originals if every copy could be allocated.
+        */
+        CNode *copies = NULL;
+
+        for (CNode *n = head; n; n = atomic_load_explicit(&n->next, memory_order_relaxed)) {
+            CNode *copy = create_node(n->hash, n->key, n->keylen, atomic_load_explicit(&n->value, memory_order_relaxed));
+            if (!copy) {
+                ok = false;
+                break;
+            }
+
+            copy->retired_next = copies;
+            copies = copy;
+        }
+
+        if (!ok) {
+            free_retired(copies, NULL);
+            break;
+        }
+
+        while (copies) {
+            CNode *copy = copies;
+            copies = copy->retired_next;
+            copy->retired_next = NULL;
+
+            _Atomic(CNode *) *dest = &to->buckets[copy->hash & (to->capacity - 1)];
+            atomic_store_explicit(&copy->next, atomic_load_explicit(dest, memory_order_relaxed), memory_order_relaxed);
+            atomic_store_explicit(dest, copy, memory_order_relaxed);
+        }
+
+        /* publishes the copies as well: a thread that sees the marker sees the filled buckets */
+        atomic_store_explicit(&from->buckets[b], FORWARDED, memory_order_release);
+
+        if (head) {
+            CNode *last = head;
+            size_t count = 1;
+
+            for (CNode *n; (n = atomic_load_explicit(&last->next, memory_order_relaxed)); last = n) {
+                last->retired_next = n;
+                count += 1;
+            }
+
+            retire_nodes(map, head, last, count);
+        }
+    }
+
+    pthread_mutex_unlock(&map->stripes[stripe].lock);
+
+    return ok;
+}
+
+/*
+Claim and migrate stripes of the resize in progress, if any, until none are left to claim.
+The thread that completes the last stripe publishes the new table.
+Must be called inside a read-side critical section.
+*/
+static void
+help_resize(BHashMapConcurrent *map) {
+    CTable *from = atomic_load_explicit(&map->resize_from, memory_order_acquire);
+    if (!from) {
+        return;
+    }
+
+    for (;;) {
+        const size_t stripe = atomic_fetch_add(&from->migrate_next_stripe, 1);
+        if (stripe >= BHM_CONCURRENT_STRIPES) {
+            return;
+        }
+
+        /* on allocation failure, retry the stripe ourselves until it succeeds */
+        while (!migrate_stripe(map, from, stripe)) {
+            sched_yield();
+        }
+
+        if (atomic_fetch_add(&from->migrate_done_stripes, 1) + 1 == BHM_CONCURRENT_STRIPES) {
+            atomic_store_explicit(&map->table, atomic_load(&from->next), memory_order_release);
+            atomic_store_explicit(&map->resize_from, NULL, memory_order_release);
+            retire_table(map, from);
+            atomic_flag_clear(&map->resizing);
+            return;
+        }
+    }
+}
+
+/*
+Start a resize if the load factor has been exceeded and no resize is in progress.
+Must be called inside a read-side critical section.
+*/
+static void
+maybe_resize(BHashMapConcurrent *map) {
+    CTable *table = atomic_load_explicit(&map->table, memory_order_acquire);
+
+    if ((double) atomic_load_explicit(&map->pair_count, memory_order_relaxed) / (double) table->capacity < map->config.max_load_factor) {
+        return;
+    }
+
+    if (atomic_flag_test_and_set(&map->resizing)) {
+        return;
+    }
+
+    /* the table may have been replaced between the load and winning the flag */
+    table = atomic_load_explicit(&map->table, memory_order_acquire);
+
+    CTable *table_new = create_table(table->capacity * map->config.resize_growth_factor);
+    if (!table_new) {
+        atomic_flag_clear(&map->resizing);
+        return;
+    }
+
+    atomic_store_explicit(&table->next, table_new, memory_order_release);
+    atomic_store_explicit(&map->resize_from, table, memory_order_release);
+
+    help_resize(map);
+}
+
+/*
+Create a new concurrent hash map. Of the configuration, the hash function fields, maximum load
+factor and growth factor are used; the growth factor is rounded up to a power of two.
+RETURN VALUE:
+    On success, return a pointer to the new map.
+    On failure, return NULL.
+*/
+BHashMapConcurrent *
+bhm_concurrent_create(const size_t capacity, const BHashMapConfig *config_user) {
+    BHashMapConcurrent *map = aligned_alloc(CACHE_LINE, sizeof(BHashMapConcurrent));
+    if (!map) {
+        return NULL;
+    }
+
+    memset(map, 0, sizeof(BHashMapConcurrent));
+
+    map->config = (BHashMapConfig) {
+        .max_load_factor = config_user && config_user->max_load_factor > 0 ? config_user->max_load_factor : BHM_CONCURRENT_DEFAULT_MAX_LOAD_FACTOR,
+        .resize_growth_factor = 2
+    };
+
+    hashing_resolve_config(&map->config, config_user);
+
+    while (config_user && map->config.resize_growth_factor < config_user->resize_growth_factor) {
+        map->config.resize_growth_factor *= 2;
+    }
+
+    size_t table_capacity = BHM_CONCURRENT_STRIPES;
+    while (table_capacity < (capacity != 0 ? capacity : BHM_CONCURRENT_DEFAULT_INITIAL_CAPACITY)) {
+        table_capacity *= 2;
+    }
+
+    CTable *table = create_table(table_capacity);
+    if (!table) {
+        free(map);
+        return NULL;
+    }
+
+    atomic_init(&map->table, table);
+    atomic_init(&map->pair_count, 0);
+    atomic_init(&map->resize_from, NULL);
+    atomic_init(&map->retired_count, 0);
+    atomic_flag_clear(&map->resizing);
+    atomic_init(&map->epoch, 0);
+
+    for (size_t i = 0; i < BHM_CONCURRENT_STRIPES; i++) {
+        pthread_mutex_init(&map->stripes[i].lock, NULL);
+    }
+
+    for (size_t i = 0; i < BHM_CONCURRENT_READER_SLOTS; i++) {
+        atomic_init(&map->readers[i].count[0], 0);
+        atomic_init(&map->readers[i].count[1], 0);
+    }
+
+    pthread_mutex_init(&map->grace_period_lock, NULL);
+    pthread_mutex_init(&map->retire_lock, NULL);
+
+    return map;
+}
+
+/*
+Insert a new key-value pair into the map, or update the associated value of an existing key.
+Safe to call concurrently with any other function of this API except bhm_concurrent_destroy.
+RETURN VALUE:
+    On success, true is returned.
+    On failure, false is returned.
+*/
+bool
+bhm_concurrent_set(BHashMapConcurrent *map, const void *key, const size_t keylen, const void *data) {
+    const uint64_t hash = hashing_hash(&map->config, key, keylen);
+    atomic_size_t *reader = read_lock(map);
+    bool inserted = false;
+
+    pthread_mutex_lock(&map->stripes[stripe_of(hash)].lock);
+
+    _Atomic(CNode *) *bucket = current_bucket(map, hash);
+    CNode *head = atomic_load_explicit(bucket, memory_order_relaxed);
+
+    for (CNode *n = head; n; n = atomic_load_explicit(&n->next, memory_order_relaxed)) {
+        if (node_matches(n, hash, key, keylen)) {
+            atomic_store_explicit(&n->value, data, memory_order_release);
+            pthread_mutex_unlock(&map->stripes[stripe_of(hash)].lock);
+            read_unlock(reader);
+            return true;
+        }
+    }
+
+    CNode *node = create_node(hash, key, keylen, data);
+    if (node) {
+        atomic_store_explicit(&node->next, head, memory_order_relaxed);
+        /* readers see either the old head or the fully initialized new node */
+        atomic_store_explicit(bucket, node, memory_order_release);
+        atomic_fetch_add_explicit(&map->pair_count, 1, memory_order_relaxed);
+        inserted = true;
+    }
+
+    pthread_mutex_unlock(&map->stripes[stripe_of(hash)].lock);
+
+    if (inserted) {
+        maybe_resize(map);
+    }
+
+    help_resize(map);
+    read_unlock(reader);
+
+    reclaim(map);
+
+    return node != NULL;
+}
+
+/*
+Get the value of a key from the map, without taking any lock.
+RETURN VALUE:
+    NULL     - key not found
+    NON-NULL - appropriate data
+*/
+void *
+bhm_concurrent_get(BHashMapConcurrent *map, const void *key, const size_t keylen) {
+    const uint64_t hash = hashing_hash(&map->config, key, keylen);
+    atomic_size_t *reader = read_lock(map);
+    void *value = NULL;
+
+    CTable *table = atomic_load_explicit(&map->table, memory_order_acquire);
+    CNode *n = atomic_load_explicit(&table->buckets[hash & (table->capacity - 1)], memory_order_acquire);
+
+    while (n == FORWARDED) {
+        table = atomic_load_explicit(&table->next, memory_order_acquire);
+        n = atomic_load_explicit(&table->buckets[hash & (table->capacity - 1)], memory_order_acquire);
+    }
+
+    for (; n; n = atomic_load_explicit(&n->next, memory_order_acquire)) {
+        if (node_matches(n, hash, key, keylen)) {
+            value = (void *) atomic_load_explicit(&n->value, memory_order_acquire);
+            break;
+        }
+    }
+
+    read_unlock(reader);
+
+    return value;
+}
+
+/*
+Remove a key from the map.
+RETURN VALUE:
+    true if the key was found and removed, false otherwise.
+*/
+bool
+bhm_concurrent_remove(BHashMapConcurrent *map, const void *key, const size_t keylen) {
+    const uint64_t hash = hashing_hash(&map->config, key, keylen);
+    atomic_size_t *reader = read_lock(map);
+    bool removed = false;
+
+    pthread_mutex_lock(&map->stripes[stripe_of(hash)].lock);
+
+    _Atomic(CNode *) *link = current_bucket(map, hash);
+
+    for (CNode *n; (n = atomic_load_explicit(link, memory_order_relaxed)); link = &n->next) {
+        if (node_matches(n, hash, key, keylen)) {
+            /* readers already past this link keep walking the removed node, which stays intact */
+            atomic_store_explicit(link, atomic_load_explicit(&n->next, memory_order_relaxed), memory_order_release);
+            atomic_fetch_sub_explicit(&map->pair_count, 1, memory_order_relaxed);
+            retire_nodes(map, n, n, 1);
+            removed = true;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&map->stripes[stripe_of(hash)].lock);
+
+    help_resize(map);
+    read_unlock(reader);
+
+    reclaim(map);
+
+    return removed;
+}
+
+static void
+iterate_bucket(CTable *table, const size_t b, bhm_iterator_callback callback_function) {
+    CNode *n = atomic_load_explicit(&table->buckets[b], memory_order_acquire);
+
+    if (n == FORWARDED) {
+        /* the pairs of bucket b are spread over the buckets of the next table congruent to b */
+        CTable *next = atomic_load_explicit(&table->next, memory_order_acquire);
+
+        for (size_t nb = b; nb < next->capacity; nb += table->capacity) {
+            iterate_bucket(next, nb, callback_function);
+        }
+
+        return;
+    }
+
+    for (; n; n = atomic_load_explicit(&n->next, memory_order_acquire)) {
+        callback_function(n->key, n->keylen, (void *) atomic_load_explicit(&n->value, memory_order_acquire));
+    }
+}
+
+/*
+For each pair in the map, call the passed in callback function. Iteration does not block writers:
+a pair inserted or removed while it is in progress may or may not be visited, but every pair that
+is in the map for the whole iteration is visited exactly once.
+*/
+void
+bhm_concurrent_iterate(BHashMapConcurrent *map, bhm_iterator_callback callback_function) {
+    atomic_size_t *reader = read_lock(map);
+    CTable *table = atomic_load_explicit(&map->table, memory_order_acquire);
+
+    for (size_t b = 0; b < table->capacity; b++) {
+        iterate_bucket(table, b, callback_function);
+    }
+
+    read_unlock(reader);
+}
+
+size_t
+bhm_concurrent_count(const BHashMapConcurrent *map) {
+    return atomic_load_explicit(&map->pair_count, memory_order_relaxed);
+}
+
+/*
+Free all resources occupied by the map. No other thread may be using the map.
+*/
+void
+bhm_concurrent_destroy(BHashMapConcurrent *map) {
+    CTable *table = atomic_load(&map->table);
+
+    for (size_t b = 0; b < table->capacity; b++) {
+        CNode *n = atomic_load(&table->buckets[b]);
+
+        while (n) {
+            CNode *next = atomic_load(&n->next);
+            free(n);
+            n = next;
+        }
+    }
+
+    free(table);
+    free_retired(map->retired_nodes, map->retired_tables);
+
+    for (size_t i = 0; i < BHM_CONCURRENT_STRIPES; i++) {
+        pthread_mutex_destroy(&map->stripes[i].lock);
+    }
+
+    pthread_mutex_destroy(&map->grace_period_lock);
+    pthread_mutex_destroy(&map->retire_lock);
+
+    free(map);
+}
@@ -0,0 +1,259 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "bhashmap_sharded.h"
+#include "hashing.h"
+
+/*
+A thread safe hash map made of independent BHashMap shards.
+
+* A key belongs to the shard picked by the high bits of its hash, so every shard holds its own
+  share of the keys in a table of its own: it has its own lock, grows and shrinks on its own, and
+  allocates its keys from its own arena. A resize stalls only the users of one shard, for the
+  time it takes to rebuild 1/N of the pairs, and writers to different shards never contend.
+
+* Each shard is guarded by a reader-writer lock. Lookups of the same shard run in parallel;
+  inserts and removals hold it exclusively, including while they resize the shard. This relies on
+  a lookup not writing to its shard, which is why shards never resize incrementally: a chaining
+  map migrates buckets from its lookups while an incremental resize is in progress.
+
+* A key is hashed once, here: the shard is picked from the hash, which is then passed on to the
+  shard with the _hashed functions. All shards share one seed, and are pinned to it (see
+  bhm_hash), so that a shard never reseeds itself into hashes of its own.
+*/
+
+#define BHM_SHARDED_DEFAULT_SHARD_COUNT 64
+
+#define CACHE_LINE 64
+
+/* one shard per cache line, so that taking the lock of a shard doesn't slow down its neighbours */
+typedef struct Shard {
+    _Alignas(CACHE_LINE) pthread_rwlock_t lock;
+    BHashMap *map;
+} Shard;
+
+struct BHashMapSharded {
+    BHashMapConfig config;
+    size_t shard_count;
+    Shard *shards;
+};
+
+/*
+Return the shard of a hash.
+
+The high bits of the hash select the shard, like BHM_INDEXING_FASTRANGE does, after running the
+hash through a mixer: every key of a shard shares those bits, so taking them straight from the
+hash would leave a shard indexing its own table with fastrange only a 1/N sliver of its buckets.
+*/
+static inline Shard *
+shard_of(const BHashMapSharded *map, const uint64_t hash) {
+    return &map->shards[(size_t) (((__uint128_t) hashing_mix64(hash) * map->shard_count) >> 64)];
+}
+
+/* destroy the first "count" shards of a map, locks included */
+static void
+destroy_shards(BHashMapSharded *map, const size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        pthread_rwlock_destroy(&map->shards[i].lock);
+        bhm_destroy(map->shards[i].map);
+    }
+}
+
+/*
+Create a sharded map of "shard_count" shards (or 64 if 0), with room for "capacity" pairs in
+total. Every shard is created with "config_user" (see bhm_create), except for:
+* "value_size", ignored: values are always stored as pointers, as a pointer into a shard would
+  only be valid until another thread modified that shard.
+* "incremental_resize_step", ignored: shards resize all at once, so that lookups never write.
+* "allocator", ignored: every shard allocates from its own built-in arena, so that no allocator
+  is ever called from several threads at once.
+RETURN VALUE:
+    On success, return a pointer to the new map.
+    On failure, return NULL.
+*/
+BHashMapSharded *
+bhm_sharded_create(const size_t shard_count, const size_t capacity, const BHashMapConfig *config_user) {
+    BHashMapSharded *map = malloc(sizeof(BHashMapSharded));
+    if (!map) {
+        return NULL;
+    }
+
+    map->shard_count = shard_count != 0 ? shard_count : BHM_SHARDED_DEFAULT_SHARD_COUNT;
+    map->shards = aligned_alloc(CACHE_LINE, map->shard_count * sizeof(Shard));
+    if (!map->shards) {
+        free(map);
+        return NULL;
+    }
+
+    BHashMapConfig config = config_user ? *config_user : (BHashMapConfig) { 0 };
+    config.value_size = 0;
+    config.incremental_resize_step = 0;
+    config.allocator = (BHashMapAllocator) { 0 };
+
+    const size_t shard_capacity = capacity != 0 ? (capacity + map->shard_count - 1) / map->shard_count : 0;
+
+    for (size_t i = 0; i < map->shard_count; i++) {
+        if (pthread_rwlock_init(&map->shards[i].lock, NULL) != 0) {
+            destroy_shards(map, i);
+            free(map->shards);
+            free(map);
+            return NULL;
+        }
+
+        map->shards[i].map = bhm_create(shard_capacity, &config);
+
+        if (!map->shards[i].map) {
+            pthread_rwlock_destroy(&map->shards[i].lock);
+            destroy_shards(map, i);
+            free(map->shards);
+            free(map);
+            return NULL;
+        }
+
+        /* the first shard draws the seed the others are created with */
+        if (i == 0) {
+            map->config = bhm_get_config(map->shards[0].map);
+            config.seed = map->config.seed;
+        }
+
+        /* pin the seed of the shard; the hash of the empty key itself is of no use */
+        bhm_hash(map->shards[i].map, "", 0);
+    }
+
+    return map;
+}
+
+/*
+Insert a new key-value pair into the map, or update the associated value of an existing key.
+Safe to call concurrently with any other function of this API except bhm_sharded_destroy.
+RETURN VALUE:
+    On success, true is returned.
+    On failure, false is returned.
+*/
+bool
+bhm_sharded_set(BHashMapSharded *map, const void *key, const size_t keylen, const void *data) {
+    const uint64_t hash = hashing_hash(&map->config, key, keylen);
+    Shard *shard = shard_of(map, hash);
+
+    pthread_rwlock_wrlock(&shard->lock);
+    const bool ok = bhm_set_hashed(shard->map, hash, key, keylen, data);
+    pthread_rwlock_unlock(&shard->lock);
+
+    return ok;
+}
+
+/*
+Retrieve the associated value of a key. Lookups only take the lock of their shard for reading,
+so they run in parallel with each other.
+RETURN VALUE:
+    If the key is in the map, its value is returned.
+    Otherwise, NULL is returned.
+*/
+void *
+bhm_sharded_get(BHashMapSharded *map, const void *key, const size_t keylen) {
+    const uint64_t hash = hashing_hash(&map->config, key, keylen);
+    Shard *shard = shard_of(map, hash);
+
+    pthread_rwlock_rdlock(&shard->lock);
+    void *value = bhm_get_hashed(shard->map, hash, key, keylen);
+    pthread_rwlock_unlock(&shard->lock);
+
+    return value;
+}
+
+/*
+Remove a key from the map.
+RETURN VALUE:
+    If the key was found and removed, true is returned.
+    Otherwise, false is returned.
+*/
+bool
+bhm_sharded_remove(BHashMapSharded *map, const void *key, const size_t keylen) {
+    const uint64_t hash = hashing_hash(&map->config, key, keylen);
+    Shard *shard = shard_of(map, hash);
+
+    pthread_rwlock_wrlock(&shard->lock);
+    const bool removed = bhm_remove_hashed(shard->map, hash, key, keylen);
+    pthread_rwlock_unlock(&shard->lock);
+
+    return removed;
+}
+
+/*
+For each pair in the map, call the passed in callback function with the key, the length of the
+key, the value and "ctx". Iteration stops early as soon as the callback returns false.
+
+The shards are visited one after the other, each while holding its lock for reading: writers are
+only blocked from the shard being visited, and a pair inserted or removed in another shard while
+the iteration is in progress may or may not be visited. The callback must not modify the map.
+RETURN VALUE:
+    If every pair was visited, true is returned.
+    If the callback stopped the iteration, false is returned.
+*/
+bool
+bhm_sharded_iterate_ctx(BHashMapSharded *map, bhm_iterator_callback_ctx callback_function, void *ctx) {
+    for (size_t i = 0; i < map->shard_count; i++) {
+        Shard *shard = &map->shards[i];
+
+        pthread_rwlock_rdlock(&shard->lock);
+        const bool complete = bhm_iterate_ctx(shard->map, callback_function, ctx);
+        pthread_rwlock_unlock(&shard->lock);
+
+        if (!complete) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+iterate_callback(const void *key, const size_t keylen, void *value, void *ctx) {
+    (*(bhm_iterator_callback *) ctx)(key, keylen, value);
+
+    return true;
+}
+
+/*
+For each pair in the map, call the passed in callback function, like bhm_sharded_iterate_ctx.
+*/
+void
+bhm_sharded_iterate(BHashMapSharded *map, bhm_iterator_callback callback_function) {
+    bhm_sharded_iterate_ctx(map, iterate_callback, &callback_function);
+}
+
+/*
+Return the count of key-value pairs in the map. The shards are counted one after the other, so
+with concurrent writers the count is only a snapshot of each shard at a different time.
+*/
+size_t
+bhm_sharded_count(BHashMapSharded *map) {
+    size_t count = 0;
+
+    for (size_t i = 0; i < map->shard_count; i++) {
+        pthread_rwlock_rdlock(&map->shards[i].lock);
+        count += bhm_count(map->shards[i].map);
+        pthread_rwlock_unlock(&map->shards[i].lock);
+    }
+
+    return count;
+}
+
+size_t
+bhm_sharded_shard_count(const BHashMapSharded *map) {
+    return map->shard_count;
+}
+
+/*
+Free all resources occupied by the map. No other thread may be using the map.
+*/
+void
+bhm_sharded_destroy(BHashMapSharded *map) {
+    destroy_shards(map, map->shard_count);
+    free(map->shards);
+    free(map);
+}
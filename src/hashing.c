@@ -0,0 +1,95 @@
+#include <time.h>
+#include <stdint.h>
+#include <sys/random.h>
+
+#include "hashing.h"
+#include "murmurhash3.h"
+#include "wyhash.h"
+
+uint64_t
+bhm_hash_wyhash(const void *data, size_t len, uint64_t seed) {
+    return wyhash64(data, len, seed);
+}
+
+uint64_t
+bhm_hash_murmur3(const void *data, size_t len, uint64_t seed) {
+    const uint32_t hash = murmur3_32(data, len, (uint32_t) (seed ^ (seed >> 32)));
+
+    /* widened like a 32-bit "hashfunc" (see hashing_hash) */
+    return hashing_mix64(hash);
+}
+
+static inline uint64_t
+splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+/*
+Return a seed that can't be predicted by whoever supplies the keys, so that they can't pick keys
+that all collide. Falls back to mixing the clock with an address if no entropy is available.
+*/
+static uint64_t
+random_seed(void) {
+    uint64_t seed;
+
+    if (getentropy(&seed, sizeof(seed)) == 0) {
+        return seed;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return splitmix64((uint64_t) now.tv_nsec ^ ((uint64_t) now.tv_sec << 32) ^ (uint64_t) (uintptr_t) &now);
+}
+
+/*
+Fill in the hash function fields of "config" from "config_user" (which may be NULL), falling back
+to defaults.
+
+A 32-bit "hashfunc" takes precedence over a 64-bit "hashfunc64", which takes precedence over the
+built-in function selected by "builtin_hash". A seed of 0 is replaced by a random one. 32-bit
+functions take no seed, so none is drawn for them.
+*/
+void
+hashing_resolve_config(BHashMapConfig *config, const BHashMapConfig *config_user) {
+    config->hashfunc = config_user ? config_user->hashfunc : NULL;
+    config->hashfunc64 = NULL;
+    config->builtin_hash = BHM_HASH_DEFAULT;
+    config->seed = 0;
+
+    if (config->hashfunc) {
+        return;
+    }
+
+    if (config_user && config_user->hashfunc64) {
+        config->hashfunc64 = config_user->hashfunc64;
+    } else {
+        config->builtin_hash = config_user && config_user->builtin_hash != BHM_HASH_DEFAULT
+                             ? config_user->builtin_hash
+                             : BHM_HASH_WYHASH;
+
+        config->hashfunc64 = config->builtin_hash == BHM_HASH_MURMUR3 ? bhm_hash_murmur3 : bhm_hash_wyhash;
+    }
+
+    config->seed = config_user && config_user->seed != 0 ? config_user->seed : random_seed();
+}
+
+/*
+Replace the seed of a resolved configuration with a new random one.
+RETURN VALUE:
+    If the hash function takes a seed, true is returned.
+    Otherwise (a 32-bit "hashfunc"), false is returned and the configuration is left alone.
+*/
+bool
+hashing_reseed(BHashMapConfig *config) {
+    if (config->hashfunc) {
+        return false;
+    }
+
+    config->seed = random_seed();
+
+    return true;
+}
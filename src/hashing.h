@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "bhashmap.h"
+
+/*
+Hash function selection shared by the hash map implementations.
+
+A map hashes keys with one of three kinds of functions: a 32-bit bhm_hash_function supplied by
+the caller, a seeded 64-bit bhm_hash_function64 supplied by the caller, or one of the built-in
+64-bit functions. All hashes are handled as 64-bit values internally.
+*/
+
+void
+hashing_resolve_config(BHashMapConfig *config, const BHashMapConfig *config_user);
+
+bool
+hashing_reseed(BHashMapConfig *config);
+
+/* bijective 64-bit mixer (the splitmix64 finalizer) */
+static inline uint64_t
+hashing_mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+/*
+Hash a key with the hash function of a resolved configuration.
+
+With a built-in hash function, keys of 4 and 8 bytes, i.e. integer keys, are instead hashed by
+XORing them with the seed and running them through a bijective mixer: a few multiplications
+instead of a full hash, and two distinct keys of the same length never share a hash.
+*/
+static inline uint64_t
+hashing_hash(const BHashMapConfig *config, const void *key, const size_t keylen) {
+    if (config->builtin_hash != BHM_HASH_DEFAULT) {
+        if (keylen == sizeof(uint64_t)) {
+            uint64_t k;
+            memcpy(&k, key, sizeof(k));
+            return hashing_mix64(k ^ config->seed);
+        }
+
+        if (keylen == sizeof(uint32_t)) {
+            uint32_t k;
+            memcpy(&k, key, sizeof(k));
+            return hashing_mix64(k ^ config->seed);
+        }
+
+        return config->hashfunc64(key, keylen, config->seed);
+    }
+
+    if (config->hashfunc) {
+        /*
+        A 32-bit hash is widened by the bijective mixer, so that every one of its bits reaches both
+        halves of the hash: indexing may take the low bits (masking), fold the halves together
+        (the finalizer of BHM_INDEXING_POW2) or take the high bits (fastrange).
+        */
+        return hashing_mix64(config->hashfunc(key, keylen));
+    }
+
+    return config->hashfunc64(key, keylen, config->seed);
+}
@@ -0,0 +1,57 @@
+#include "histogram.h"
+
+void
+histogram_init(Histogram *histogram) {
+    *histogram = (Histogram) {
+        .count = 0
+    };
+}
+
+/* the highest value that falls into a bin */
+static uint64_t
+bin_highest(const size_t bin) {
+    if (bin < HISTOGRAM_SUB_BUCKETS) {
+        return bin;
+    }
+
+    const unsigned shift = bin / HISTOGRAM_SUB_BUCKETS - 1;
+    const uint64_t lowest = (uint64_t) (HISTOGRAM_SUB_BUCKETS + bin % HISTOGRAM_SUB_BUCKETS) << shift;
+
+    return lowest + (((uint64_t) 1 << shift) - 1);
+}
+
+/*
+Return the value below or at which "percentile" percent of the recorded values lie, rounded up to
+the highest value of its bin (but never above the largest value recorded), or 0 if the histogram
+is empty.
+*/
+uint64_t
+histogram_percentile(const Histogram *histogram, const double percentile) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    /* the rank of the value, counting from 1 */
+    uint64_t rank = (uint64_t) (percentile / 100 * (double) histogram->count + 0.5);
+
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    if (rank > histogram->count) {
+        rank = histogram->count;
+    }
+
+    uint64_t seen = 0;
+
+    for (size_t bin = 0; bin < HISTOGRAM_BIN_COUNT; bin++) {
+        seen += histogram->bins[bin];
+
+        if (seen >= rank) {
+            const uint64_t highest = bin_highest(bin);
+            return highest < histogram->max ? highest : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Log-bucketed histogram of nanosecond latencies, in the style of HdrHistogram.
+
+Values are grouped by their highest set bit, and every power of two is split into
+HISTOGRAM_SUB_BUCKETS linear bins, so that a bin is never wider than 1/HISTOGRAM_SUB_BUCKETS of
+the values it holds: percentiles are accurate to 12.5% whether they are 30ns or 30ms. Values below
+HISTOGRAM_SUB_BUCKETS have exact bins. Recording a value is a count-leading-zeros, a shift and an
+increment.
+*/
+
+#define HISTOGRAM_SUB_BUCKET_BITS 3
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BIN_COUNT ((64 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct Histogram {
+    uint64_t bins[HISTOGRAM_BIN_COUNT];
+
+    uint64_t count,
+             total,
+             min,
+             max;
+} Histogram;
+
+static inline size_t
+histogram_bin(const uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return value;
+    }
+
+    const unsigned shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BUCKET_BITS;
+
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS + ((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+static inline void
+histogram_record(Histogram *histogram, const uint64_t value) {
+    histogram->bins[histogram_bin(value)] += 1;
+    histogram->count += 1;
+    histogram->total += value;
+
+    if (value < histogram->min || histogram->count == 1) {
+        histogram->min = value;
+    }
+
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+void
+histogram_init(Histogram *histogram);
+
+uint64_t
+histogram_percentile(const Histogram *histogram, const double percentile);
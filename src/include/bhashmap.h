@@ -7,37 +7,262 @@
 
 typedef struct BHashMap BHashMap;
 typedef void (*bhm_iterator_callback)(const void *key, const size_t keylen, void *value);
+typedef bool (*bhm_iterator_callback_ctx)(const void *key, const size_t keylen, void *value, void *ctx);
+typedef void (*bhm_upsert_callback)(void *value, const bool inserted, void *ctx);
 typedef uint32_t (*bhm_hash_function)(const void *data, size_t len);
+typedef uint64_t (*bhm_hash_function64)(const void *data, size_t len, uint64_t seed);
+
+typedef enum BHashMapHash {
+    BHM_HASH_DEFAULT = 0,
+    BHM_HASH_WYHASH,
+    BHM_HASH_MURMUR3
+} BHashMapHash;
+
+typedef enum BHashMapBackend {
+    BHM_BACKEND_CHAINING = 0,
+    BHM_BACKEND_OPEN_ADDRESSING,
+    BHM_BACKEND_DENSE,
+    /* read-only, memory-mapped from a file written by bhm_save; see bhm_open_mmap */
+    BHM_BACKEND_SNAPSHOT
+} BHashMapBackend;
+
+typedef enum BHashMapIndexing {
+    BHM_INDEXING_AUTO = 0,
+    BHM_INDEXING_POW2,
+    BHM_INDEXING_FASTRANGE,
+    BHM_INDEXING_MODULO
+} BHashMapIndexing;
+
+typedef struct BHashMapAllocator {
+    void *(*allocate)(void *ctx, size_t size);
+    void (*deallocate)(void *ctx, void *ptr, size_t size);
+    void *ctx;
+} BHashMapAllocator;
 
 typedef struct BHashMapConfig {
     bhm_hash_function hashfunc;
     double max_load_factor;
     size_t resize_growth_factor;
+    BHashMapBackend backend;
+    BHashMapAllocator allocator;
+    size_t incremental_resize_step;
+    BHashMapIndexing indexing;
+    bhm_hash_function64 hashfunc64;
+    BHashMapHash builtin_hash;
+    uint64_t seed;
+    bool borrow_keys;
+    double min_load_factor;
+    size_t max_chain_length;
+    /* if not 0, values are copied into the map rather than stored as pointers (see bhm_set) */
+    size_t value_size;
 } BHashMapConfig;
 
+/*
+Cursor over the pairs of a map (see bhm_iter_begin). Its members are internal: the cursor is only
+declared here so that it can live on the stack.
+*/
+typedef struct BHashMapIterator {
+    const BHashMap *map;
+    size_t idx,
+           end,
+           old_idx,
+           old_end;
+    const void *pair;
+    uint32_t mask;
+} BHashMapIterator;
+
+/* number of bins of the histograms of BHashMapStats; the last bin also counts everything above it */
+#define BHM_STATS_HISTOGRAM_SIZE 16
+
+/*
+Statistics of a map, filled in by bhm_get_stats. With chaining, a probe is a pair compared along
+a chain; otherwise, it is a group of control bytes.
+*/
+typedef struct BHashMapStats {
+    BHashMapBackend backend;
+    size_t capacity,
+           count;
+    double load_factor;
+
+    /* chaining: the number of buckets holding 0, 1, 2, ... pairs */
+    size_t chain_length_histogram[BHM_STATS_HISTOGRAM_SIZE];
+    /* the number of pairs that a lookup finds after 1, 2, 3, ... probes */
+    size_t probe_length_histogram[BHM_STATS_HISTOGRAM_SIZE];
+    size_t max_probe_length;
+    double mean_probe_length;
+
+    /* deleted slots (open addressing) or removed entries not compacted away yet (dense) */
+    size_t tombstone_count;
+
+    /* bytes of the table itself, of the pair nodes (chaining), and of the keys copied out of line */
+    size_t table_bytes,
+           node_bytes,
+           key_bytes;
+    /* bytes reserved by the built-in arena, including the memory of removed pairs it holds on to */
+    size_t arena_bytes;
+
+    /* rebuilds of the table (growing, shrinking and purging deleted slots) and their total time */
+    size_t resize_count;
+    uint64_t resize_ns;
+    size_t reseed_count;
+
+    /* operation counters, only collected while enabled with bhm_enable_counters */
+    bool counters_enabled;
+    uint64_t operation_count,
+             hit_count,
+             miss_count,
+             probe_count;
+} BHashMapStats;
+
+/* operations whose latency is recorded (see bhm_enable_latency) */
+typedef enum BHashMapOperation {
+    BHM_OPERATION_GET = 0,
+    BHM_OPERATION_SET,
+    BHM_OPERATION_REMOVE,
+    BHM_OPERATION_RESIZE,
+    BHM_OPERATION_COUNT
+} BHashMapOperation;
+
+/* latency distribution of one operation, filled in by bhm_get_latency */
+typedef struct BHashMapLatency {
+    uint64_t count,
+             min_ns,
+             max_ns,
+             p50_ns,
+             p90_ns,
+             p99_ns,
+             p999_ns;
+    double mean_ns;
+} BHashMapLatency;
+
 BHashMap *
 bhm_create(const size_t capacity, const BHashMapConfig *config_user);
 
+BHashMap *
+bhm_build(const void *const *keys, const size_t *keylens, const void *const *values, const size_t n, const BHashMapConfig *config);
+
+bool
+bhm_reserve(BHashMap *map, const size_t count);
+
+bool
+bhm_shrink_to_fit(BHashMap *map);
+
+bool
+bhm_clear(BHashMap *map);
+
 bool
 bhm_set(BHashMap *map, const void *key, const size_t keylen, const void *data); 
 
 void *
 bhm_get(const BHashMap *map, const void *key, const size_t keylen); 
 
+void
+bhm_get_batch(const BHashMap *map, const void *const *keys, const size_t *keylens, void **out_values, const size_t n);
+
+bool
+bhm_set_batch(BHashMap *map, const void *const *keys, const size_t *keylens, const void *const *values, const size_t n);
+
 bool 
 bhm_remove(BHashMap *map, const void *key, const size_t keylen); 
 
+void *
+bhm_get_or_insert(BHashMap *map, const void *key, const size_t keylen, const void *data, bool *inserted);
+
+bool
+bhm_upsert(BHashMap *map, const void *key, const size_t keylen, bhm_upsert_callback callback, void *ctx);
+
+uint64_t
+bhm_hash(const BHashMap *map, const void *key, const size_t keylen);
+
+bool
+bhm_set_hashed(BHashMap *map, const uint64_t hash, const void *key, const size_t keylen, const void *data);
+
+void *
+bhm_get_hashed(const BHashMap *map, const uint64_t hash, const void *key, const size_t keylen);
+
+bool
+bhm_remove_hashed(BHashMap *map, const uint64_t hash, const void *key, const size_t keylen);
+
+void *
+bhm_get_or_insert_hashed(BHashMap *map, const uint64_t hash, const void *key, const size_t keylen, const void *data, bool *inserted);
+
+void
+bhm_get_batch_hashed(const BHashMap *map, const uint64_t *hashes, const void *const *keys, const size_t *keylens, void **out_values, const size_t n);
+
+bool
+bhm_set_batch_hashed(BHashMap *map, const uint64_t *hashes, const void *const *keys, const size_t *keylens, const void *const *values, const size_t n);
+
+bool
+bhm_set_u64(BHashMap *map, const uint64_t key, const void *data);
+
+void *
+bhm_get_u64(const BHashMap *map, const uint64_t key);
+
+bool
+bhm_remove_u64(BHashMap *map, const uint64_t key);
+
+bool
+bhm_set_u32(BHashMap *map, const uint32_t key, const void *data);
+
+void *
+bhm_get_u32(const BHashMap *map, const uint32_t key);
+
+bool
+bhm_remove_u32(BHashMap *map, const uint32_t key);
+
 void
 bhm_destroy(BHashMap *map);
 
+void
+bhm_get_stats(const BHashMap *map, BHashMapStats *stats);
+
+void
+bhm_enable_counters(BHashMap *map, const bool enabled);
+
+bool
+bhm_enable_latency(BHashMap *map, const size_t sample_interval);
+
+bool
+bhm_get_latency(const BHashMap *map, const BHashMapOperation operation, BHashMapLatency *latency);
+
+uint64_t
+bhm_latency_percentile(const BHashMap *map, const BHashMapOperation operation, const double percentile);
+
 void
 bhm_print_debug_stats(const BHashMap *map, FILE *stream);
 
 void
 bhm_iterate(const BHashMap *map, bhm_iterator_callback callback_function); 
 
+bool
+bhm_iterate_ctx(const BHashMap *map, bhm_iterator_callback_ctx callback_function, void *ctx);
+
+bool
+bhm_iterate_range(const BHashMap *map, const size_t shard_idx, const size_t shard_count, bhm_iterator_callback_ctx callback_function, void *ctx);
+
+void
+bhm_iter_begin(const BHashMap *map, BHashMapIterator *iter);
+
+void
+bhm_iter_begin_range(const BHashMap *map, const size_t shard_idx, const size_t shard_count, BHashMapIterator *iter);
+
+bool
+bhm_iter_next(BHashMapIterator *iter, const void **key, size_t *keylen, void **value);
+
 size_t
 bhm_count(const BHashMap *map); 
 
 BHashMapConfig
 bhm_get_config(const BHashMap *map);
+
+bool
+bhm_save(const BHashMap *map, const char *path, const size_t value_size);
+
+BHashMap *
+bhm_open_mmap(const char *path);
+
+uint64_t
+bhm_hash_wyhash(const void *data, size_t len, uint64_t seed);
+
+uint64_t
+bhm_hash_murmur3(const void *data, size_t len, uint64_t seed);
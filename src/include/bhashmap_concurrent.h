@@ -0,0 +1,30 @@
+#pragma once
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bhashmap.h"
+
+typedef struct BHashMapConcurrent BHashMapConcurrent;
+
+BHashMapConcurrent *
+bhm_concurrent_create(const size_t capacity, const BHashMapConfig *config_user);
+
+bool
+bhm_concurrent_set(BHashMapConcurrent *map, const void *key, const size_t keylen, const void *data);
+
+void *
+bhm_concurrent_get(BHashMapConcurrent *map, const void *key, const size_t keylen);
+
+bool
+bhm_concurrent_remove(BHashMapConcurrent *map, const void *key, const size_t keylen);
+
+void
+bhm_concurrent_iterate(BHashMapConcurrent *map, bhm_iterator_callback callback_function);
+
+size_t
+bhm_concurrent_count(const BHashMapConcurrent *map);
+
+void
+bhm_concurrent_destroy(BHashMapConcurrent *map);
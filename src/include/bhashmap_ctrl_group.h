@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+Helpers for scanning groups of control bytes of an open-addressed table.
+
+Every slot of the table has a matching control byte: either one of the special negative
+values below, or a non-negative 7-bit tag taken from the hash of the key stored in the slot.
+A group is BHM_CTRL_GROUP_WIDTH consecutive, aligned control bytes. The match functions return
+a bitmask with bit i set if byte i of the group satisfies the condition, so an entire group
+is tested with a single compare when SIMD is available.
+*/
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BHM_CTRL_GROUP_WIDTH 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define BHM_CTRL_GROUP_WIDTH 16
+#else
+#define BHM_CTRL_GROUP_WIDTH 16
+#endif
+
+#define BHM_CTRL_EMPTY   ((int8_t) -128)
+#define BHM_CTRL_DELETED ((int8_t) -2)
+
+#define BHM_CTRL_TAG(hash) ((int8_t) ((hash) & 0x7F))
+
+typedef uint32_t bhm_ctrl_mask;
+
+/* index of the lowest set bit of a non-zero mask */
+#define BHM_CTRL_MASK_FIRST(mask) ((unsigned) __builtin_ctz(mask))
+
+/* mask with bit i set if control byte i of the group equals "tag" */
+static inline bhm_ctrl_mask
+bhm_ctrl_group_match(const int8_t *group, const int8_t tag) {
+    #if defined(__AVX2__)
+    const __m256i g = _mm256_load_si256((const __m256i *) group);
+    return (bhm_ctrl_mask) _mm256_movemask_epi8(_mm256_cmpeq_epi8(g, _mm256_set1_epi8(tag)));
+    #elif defined(__SSE2__)
+    const __m128i g = _mm_load_si128((const __m128i *) group);
+    return (bhm_ctrl_mask) _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(tag)));
+    #else
+    bhm_ctrl_mask mask = 0;
+    for (unsigned i = 0; i < BHM_CTRL_GROUP_WIDTH; i++) {
+        mask |= (bhm_ctrl_mask) (group[i] == tag) << i;
+    }
+    return mask;
+    #endif
+}
+
+/* mask of the empty slots of the group */
+static inline bhm_ctrl_mask
+bhm_ctrl_group_match_empty(const int8_t *group) {
+    return bhm_ctrl_group_match(group, BHM_CTRL_EMPTY);
+}
+
+/* mask of the slots of the group that are either empty or deleted (both have the sign bit set) */
+static inline bhm_ctrl_mask
+bhm_ctrl_group_match_free(const int8_t *group) {
+    #if defined(__AVX2__)
+    return (bhm_ctrl_mask) _mm256_movemask_epi8(_mm256_load_si256((const __m256i *) group));
+    #elif defined(__SSE2__)
+    return (bhm_ctrl_mask) _mm_movemask_epi8(_mm_load_si128((const __m128i *) group));
+    #else
+    bhm_ctrl_mask mask = 0;
+    for (unsigned i = 0; i < BHM_CTRL_GROUP_WIDTH; i++) {
+        mask |= (bhm_ctrl_mask) (group[i] < 0) << i;
+    }
+    return mask;
+    #endif
+}
+
+/* mask of the slots of the group that hold a key */
+static inline bhm_ctrl_mask
+bhm_ctrl_group_match_full(const int8_t *group) {
+    #if BHM_CTRL_GROUP_WIDTH == 32
+    return ~bhm_ctrl_group_match_free(group);
+    #else
+    return ~bhm_ctrl_group_match_free(group) & 0xFFFFu;
+    #endif
+}
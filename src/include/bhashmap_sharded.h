@@ -0,0 +1,36 @@
+#pragma once
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bhashmap.h"
+
+typedef struct BHashMapSharded BHashMapSharded;
+
+BHashMapSharded *
+bhm_sharded_create(const size_t shard_count, const size_t capacity, const BHashMapConfig *config_user);
+
+bool
+bhm_sharded_set(BHashMapSharded *map, const void *key, const size_t keylen, const void *data);
+
+void *
+bhm_sharded_get(BHashMapSharded *map, const void *key, const size_t keylen);
+
+bool
+bhm_sharded_remove(BHashMapSharded *map, const void *key, const size_t keylen);
+
+void
+bhm_sharded_iterate(BHashMapSharded *map, bhm_iterator_callback callback_function);
+
+bool
+bhm_sharded_iterate_ctx(BHashMapSharded *map, bhm_iterator_callback_ctx callback_function, void *ctx);
+
+size_t
+bhm_sharded_count(BHashMapSharded *map);
+
+size_t
+bhm_sharded_shard_count(const BHashMapSharded *map);
+
+void
+bhm_sharded_destroy(BHashMapSharded *map);
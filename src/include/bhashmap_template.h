@@ -0,0 +1,295 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "bhashmap_ctrl_group.h"
+
+/*
+Compile-time specialized hash maps.
+
+BHM_DEFINE_MAP(name, KeyT, ValT, hash, eq) defines a map type "name" whose keys of type KeyT and
+values of type ValT are stored by value in one flat array of slots, along with the functions
+below. "hash" is a function (or function-like macro) taking a KeyT and returning a uint64_t, and
+"eq" one taking two KeyTs and returning whether they are equal. Both are called directly, so
+they are inlined into every operation, and no operation allocates anything but the table.
+
+    bool  name_init(name *map, size_t capacity);
+    void  name_destroy(name *map);
+    bool  name_set(name *map, KeyT key, ValT value);
+    ValT *name_get(const name *map, KeyT key);
+    bool  name_remove(name *map, KeyT key);
+    size_t name_count(const name *map);
+    void  name_iterate(const name *map, void (*callback)(const KeyT *key, ValT *value));
+
+The table works like the open addressing backend of BHashMap: a power-of-two number of slots,
+each with a control byte holding a 7-bit tag of its hash, probed a group of control bytes at a
+time. name_get returns a pointer to the value in the table, which is valid until the next call
+that modifies the map.
+*/
+
+#define BHM_TEMPLATE_DEFAULT_CAPACITY 32
+#define BHM_TEMPLATE_MAX_LOAD_FACTOR 0.875
+
+/* bijective 64-bit mixer (the splitmix64 finalizer), a ready-made "hash" for integer keys */
+static inline uint64_t
+bhm_mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static inline bool
+bhm_eq_u64(const uint64_t a, const uint64_t b) {
+    return a == b;
+}
+
+static inline bool
+bhm_eq_u32(const uint32_t a, const uint32_t b) {
+    return a == b;
+}
+
+static inline uint64_t
+bhm_hash_u64(const uint64_t key) {
+    return bhm_mix64(key);
+}
+
+static inline uint64_t
+bhm_hash_u32(const uint32_t key) {
+    return bhm_mix64(key);
+}
+
+static inline size_t
+bhm_template_round_capacity(const size_t capacity) {
+    size_t rounded = BHM_CTRL_GROUP_WIDTH;
+
+    while (rounded < capacity) {
+        rounded *= 2;
+    }
+
+    return rounded;
+}
+
+/*
+Allocate a table of "capacity" slots of "slot_size" bytes, and its control bytes, all empty.
+RETURN VALUE:
+    On success, the slots are returned and the control bytes are stored in *ctrl.
+    On failure, NULL is returned and nothing is allocated.
+*/
+static inline void *
+bhm_template_alloc_table(const size_t capacity, const size_t slot_size, int8_t **ctrl) {
+    *ctrl = aligned_alloc(BHM_CTRL_GROUP_WIDTH, capacity);
+    void *slots = malloc(capacity * slot_size);
+
+    if (!(*ctrl) || !slots) {
+        free(*ctrl);
+        free(slots);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < capacity; i++) {
+        (*ctrl)[i] = BHM_CTRL_EMPTY;
+    }
+
+    return slots;
+}
+
+#define BHM_DEFINE_MAP(name, KeyT, ValT, hash, eq)                                                  \
+                                                                                                    \
+typedef struct name##_slot {                                                                        \
+    KeyT key;                                                                                       \
+    ValT value;                                                                                     \
+} name##_slot;                                                                                      \
+                                                                                                    \
+typedef struct name {                                                                               \
+    int8_t *ctrl;                                                                                   \
+    name##_slot *slots;                                                                             \
+    size_t capacity,                                                                                \
+           count,                                                                                   \
+           tombstone_count;                                                                         \
+} name;                                                                                             \
+                                                                                                    \
+static inline bool                                                                                  \
+name##_init(name *map, const size_t capacity) {                                                     \
+    *map = (name) {                                                                                 \
+        .capacity = bhm_template_round_capacity(capacity ? capacity : BHM_TEMPLATE_DEFAULT_CAPACITY) \
+    };                                                                                              \
+                                                                                                    \
+    map->slots = bhm_template_alloc_table(map->capacity, sizeof(name##_slot), &map->ctrl);          \
+                                                                                                    \
+    return map->slots != NULL;                                                                      \
+}                                                                                                   \
+                                                                                                    \
+static inline void                                                                                  \
+name##_destroy(name *map) {                                                                         \
+    free(map->ctrl);                                                                                \
+    free(map->slots);                                                                               \
+    *map = (name) { 0 };                                                                            \
+}                                                                                                   \
+                                                                                                    \
+/* index of the slot holding "key" or SIZE_MAX, and in *insert_idx the first free slot probed */    \
+static inline size_t                                                                                \
+name##_find(const name *map, const uint64_t h, const KeyT key, size_t *insert_idx) {                \
+    const size_t group_mask = map->capacity / BHM_CTRL_GROUP_WIDTH - 1;                             \
+    const int8_t tag = BHM_CTRL_TAG(h);                                                             \
+                                                                                                    \
+    size_t group = (h >> 7) & group_mask;                                                           \
+                                                                                                    \
+    if (insert_idx) {                                                                               \
+        *insert_idx = SIZE_MAX;                                                                     \
+    }                                                                                               \
+                                                                                                    \
+    for (size_t step = 1; step <= group_mask + 1; step++) {                                         \
+        const size_t base = group * BHM_CTRL_GROUP_WIDTH;                                           \
+        const int8_t *ctrl = &map->ctrl[base];                                                      \
+                                                                                                    \
+        for (bhm_ctrl_mask match = bhm_ctrl_group_match(ctrl, tag); match; match &= match - 1) {    \
+            if (eq(map->slots[base + BHM_CTRL_MASK_FIRST(match)].key, key)) {                       \
+                return base + BHM_CTRL_MASK_FIRST(match);                                           \
+            }                                                                                       \
+        }                                                                                           \
+                                                                                                    \
+        if (insert_idx && *insert_idx == SIZE_MAX) {                                                \
+            const bhm_ctrl_mask free_mask = bhm_ctrl_group_match_free(ctrl);                        \
+                                                                                                    \
+            if (free_mask) {                                                                        \
+                *insert_idx = base + BHM_CTRL_MASK_FIRST(free_mask);                                \
+            }                                                                                       \
+        }                                                                                           \
+                                                                                                    \
+        if (bhm_ctrl_group_match_empty(ctrl)) {                                                     \
+            return SIZE_MAX;                                                                        \
+        }                                                                                           \
+                                                                                                    \
+        group = (group + step) & group_mask;                                                        \
+    }                                                                                               \
+                                                                                                    \
+    return SIZE_MAX;                                                                                \
+}                                                                                                   \
+                                                                                                    \
+/* rebuild the table with "capacity_new" slots, dropping all deleted slots */                       \
+static inline bool                                                                                  \
+name##_rehash(name *map, const size_t capacity_new) {                                               \
+    int8_t *ctrl_new;                                                                               \
+    name##_slot *slots_new = bhm_template_alloc_table(capacity_new, sizeof(name##_slot), &ctrl_new); \
+                                                                                                    \
+    if (!slots_new) {                                                                               \
+        return false;                                                                               \
+    }                                                                                               \
+                                                                                                    \
+    const size_t group_mask = capacity_new / BHM_CTRL_GROUP_WIDTH - 1;                              \
+                                                                                                    \
+    for (size_t idx_old = 0; idx_old < map->capacity; idx_old++) {                                  \
+        if (map->ctrl[idx_old] < 0) {                                                               \
+            continue;                                                                               \
+        }                                                                                           \
+                                                                                                    \
+        const uint64_t h = hash(map->slots[idx_old].key);                                           \
+        size_t group = (h >> 7) & group_mask;                                                       \
+                                                                                                    \
+        for (size_t step = 1; ; step++) {                                                           \
+            const bhm_ctrl_mask empty = bhm_ctrl_group_match_empty(&ctrl_new[group * BHM_CTRL_GROUP_WIDTH]); \
+                                                                                                    \
+            if (empty) {                                                                            \
+                const size_t idx_new = group * BHM_CTRL_GROUP_WIDTH + BHM_CTRL_MASK_FIRST(empty);   \
+                ctrl_new[idx_new] = BHM_CTRL_TAG(h);                                                \
+                slots_new[idx_new] = map->slots[idx_old];                                           \
+                break;                                                                              \
+            }                                                                                       \
+                                                                                                    \
+            group = (group + step) & group_mask;                                                    \
+        }                                                                                           \
+    }                                                                                               \
+                                                                                                    \
+    free(map->ctrl);                                                                                \
+    free(map->slots);                                                                               \
+                                                                                                    \
+    map->ctrl = ctrl_new;                                                                           \
+    map->slots = slots_new;                                                                         \
+    map->capacity = capacity_new;                                                                   \
+    map->tombstone_count = 0;                                                                       \
+                                                                                                    \
+    return true;                                                                                    \
+}                                                                                                   \
+                                                                                                    \
+static inline bool                                                                                  \
+name##_set(name *map, const KeyT key, const ValT value) {                                           \
+    const uint64_t h = hash(key);                                                                   \
+    size_t insert_idx;                                                                              \
+    const size_t idx = name##_find(map, h, key, &insert_idx);                                       \
+                                                                                                    \
+    if (idx != SIZE_MAX) {                                                                          \
+        map->slots[idx].value = value;                                                              \
+        return true;                                                                                \
+    }                                                                                               \
+                                                                                                    \
+    /* only possible if growing the table failed before */                                          \
+    if (insert_idx == SIZE_MAX) {                                                                   \
+        return false;                                                                               \
+    }                                                                                               \
+                                                                                                    \
+    if (map->ctrl[insert_idx] == BHM_CTRL_DELETED) {                                                \
+        map->tombstone_count -= 1;                                                                  \
+    }                                                                                               \
+                                                                                                    \
+    map->ctrl[insert_idx] = BHM_CTRL_TAG(h);                                                        \
+    map->slots[insert_idx] = (name##_slot) { .key = key, .value = value };                          \
+    map->count += 1;                                                                                \
+                                                                                                    \
+    const double load_factor = (double) (map->count + map->tombstone_count) / (double) map->capacity; \
+                                                                                                    \
+    if (load_factor >= BHM_TEMPLATE_MAX_LOAD_FACTOR) {                                              \
+        /* if most of the load is deleted slots, purging them is enough */                          \
+        const size_t capacity_new = map->count < map->tombstone_count                               \
+                                  ? map->capacity                                                   \
+                                  : map->capacity * 2;                                              \
+                                                                                                    \
+        /* the pair is in; if growing fails, the next insert will try again */                      \
+        name##_rehash(map, capacity_new);                                                           \
+    }                                                                                               \
+                                                                                                    \
+    return true;                                                                                    \
+}                                                                                                   \
+                                                                                                    \
+static inline ValT *                                                                                \
+name##_get(const name *map, const KeyT key) {                                                       \
+    const size_t idx = name##_find(map, hash(key), key, NULL);                                      \
+                                                                                                    \
+    return idx != SIZE_MAX ? &map->slots[idx].value : NULL;                                         \
+}                                                                                                   \
+                                                                                                    \
+static inline bool                                                                                  \
+name##_remove(name *map, const KeyT key) {                                                          \
+    const size_t idx = name##_find(map, hash(key), key, NULL);                                      \
+                                                                                                    \
+    if (idx == SIZE_MAX) {                                                                          \
+        return false;                                                                               \
+    }                                                                                               \
+                                                                                                    \
+    if (bhm_ctrl_group_match_empty(&map->ctrl[idx - idx % BHM_CTRL_GROUP_WIDTH])) {                 \
+        map->ctrl[idx] = BHM_CTRL_EMPTY;                                                            \
+    } else {                                                                                        \
+        map->ctrl[idx] = BHM_CTRL_DELETED;                                                          \
+        map->tombstone_count += 1;                                                                  \
+    }                                                                                               \
+                                                                                                    \
+    map->count -= 1;                                                                                \
+                                                                                                    \
+    return true;                                                                                    \
+}                                                                                                   \
+                                                                                                    \
+static inline size_t                                                                                \
+name##_count(const name *map) {                                                                     \
+    return map->count;                                                                              \
+}                                                                                                   \
+                                                                                                    \
+static inline void                                                                                  \
+name##_iterate(const name *map, void (*callback)(const KeyT *key, ValT *value)) {                   \
+    for (size_t i = 0; i < map->capacity; i++) {                                                    \
+        if (map->ctrl[i] >= 0) {                                                                    \
+            callback(&map->slots[i].key, &map->slots[i].value);                                     \
+        }                                                                                           \
+    }                                                                                               \
+}
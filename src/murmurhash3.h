@@ -1,6 +1,9 @@
+#pragma once
+
 #include <stdint.h>
+#include <string.h>
 
-uint32_t
+static inline uint32_t
 murmur3_32(const char *key, uint32_t len, uint32_t seed) {
     static const uint32_t c1 = 0xcc9e2d51;
     static const uint32_t c2 = 0x1b873593;
@@ -12,10 +15,11 @@ murmur3_32(const char *key, uint32_t len, uint32_t seed) {
     uint32_t hash = seed;
 
     const int nblocks = len / 4;
-    const uint32_t *blocks = (const uint32_t *) key;
     int i;
     for (i = 0; i < nblocks; i++) {
-        uint32_t k = blocks[i];
+        /* keys can start at any address, so the blocks are loaded without assuming alignment */
+        uint32_t k;
+        memcpy(&k, key + i * 4, sizeof(k));
         k *= c1;
         k = (k << r1) | (k >> (32 - r1));
         k *= c2;
@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+#include "bhashmap_ctrl_group.h"
+
+/* control bytes are loaded a whole group at a time, so they start at a group-aligned offset */
+#define SNAPSHOT_CTRL_ALIGNMENT 64
+
+static inline uint64_t
+align_up(const uint64_t offset, const uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+/*
+Prepare a writer for a snapshot of "count" entries. The table is sized so that its load factor
+stays below "max_load_factor".
+RETURN VALUE:
+    On success, true is returned.
+    On failure, false is returned.
+*/
+bool
+snapshot_writer_init(SnapshotWriter *writer, const size_t count, const uint32_t builtin_hash, const uint64_t seed, const double max_load_factor, const size_t value_size) {
+    size_t capacity = BHM_CTRL_GROUP_WIDTH;
+
+    while ((double) count >= (double) capacity * max_load_factor) {
+        capacity *= 2;
+    }
+
+    *writer = (SnapshotWriter) {
+        .header = (SnapshotHeader) {
+            .magic = SNAPSHOT_MAGIC,
+            .version = SNAPSHOT_VERSION,
+            .byte_order_mark = SNAPSHOT_BYTE_ORDER_MARK,
+            .group_width = BHM_CTRL_GROUP_WIDTH,
+            .builtin_hash = builtin_hash,
+            .seed = seed,
+            .max_load_factor = max_load_factor,
+            .capacity = capacity,
+            .count = 0,
+            .value_size = value_size
+        }
+    };
+
+    writer->ctrl = malloc(capacity);
+    writer->slots = calloc(capacity, sizeof(SnapshotSlot));
+    writer->values = value_size > 0 ? malloc(count * value_size) : NULL;
+
+    if (!writer->ctrl || !writer->slots || (value_size > 0 && count > 0 && !writer->values)) {
+        snapshot_writer_discard(writer);
+        return false;
+    }
+
+    memset(writer->ctrl, BHM_CTRL_EMPTY, capacity);
+
+    return true;
+}
+
+/*
+Add an entry to the snapshot. Keys must be unique.
+RETURN VALUE:
+    On success, true is returned.
+    On failure, false is returned.
+*/
+bool
+snapshot_writer_add(SnapshotWriter *writer, const uint64_t hash, const void *key, const size_t keylen, const void *value) {
+    SnapshotSlot slot = {
+        .hash = hash,
+        .keylen = keylen
+    };
+
+    if (keylen <= SNAPSHOT_INLINE_KEY_MAX) {
+        memcpy(slot.key.bytes, key, keylen);
+    } else {
+        if (writer->keys_size + keylen > writer->keys_capacity) {
+            size_t capacity_new = writer->keys_capacity > 0 ? writer->keys_capacity * 2 : 4096;
+            while (capacity_new < writer->keys_size + keylen) {
+                capacity_new *= 2;
+            }
+
+            unsigned char *keys_new = realloc(writer->keys, capacity_new);
+            if (!keys_new) {
+                return false;
+            }
+
+            writer->keys = keys_new;
+            writer->keys_capacity = capacity_new;
+        }
+
+        /* relative to the start of the key bytes until the final offsets are known */
+        slot.key.offset = writer->keys_size;
+        memcpy(writer->keys + writer->keys_size, key, keylen);
+        writer->keys_size += keylen;
+    }
+
+    if (writer->header.value_size > 0) {
+        slot.value = writer->values_size;
+
+        /* a NULL value pointer has nothing to copy from, and is saved as zeroes like bhm_set does */
+        if (value) {
+            memcpy(writer->values + writer->values_size, value, writer->header.value_size);
+        } else {
+            memset(writer->values + writer->values_size, 0, writer->header.value_size);
+        }
+
+        writer->values_size += writer->header.value_size;
+    } else {
+        slot.value = (uint64_t) (uintptr_t) value;
+    }
+
+    /* the table holds no deleted slots and no duplicate keys: take the first empty slot */
+    const size_t group_mask = writer->header.capacity / BHM_CTRL_GROUP_WIDTH - 1;
+    size_t group = (hash >> 7) & group_mask;
+
+    for (size_t step = 1; ; step++) {
+        const bhm_ctrl_mask empty = bhm_ctrl_group_match_empty(&writer->ctrl[group * BHM_CTRL_GROUP_WIDTH]);
+
+        if (empty) {
+            const size_t idx = group * BHM_CTRL_GROUP_WIDTH + BHM_CTRL_MASK_FIRST(empty);
+
+            writer->ctrl[idx] = BHM_CTRL_TAG(hash);
+            writer->slots[idx] = slot;
+            break;
+        }
+
+        group = (group + step) & group_mask;
+    }
+
+    writer->header.count += 1;
+
+    return true;
+}
+
+static bool
+write_padded(FILE *file, const void *data, const size_t size, const uint64_t offset_end) {
+    static const unsigned char zeroes[SNAPSHOT_CTRL_ALIGNMENT] = { 0 };
+
+    if (size > 0 && fwrite(data, 1, size, file) != size) {
+        return false;
+    }
+
+    for (uint64_t position = ftell(file); position < offset_end; ) {
+        const size_t n = offset_end - position < sizeof(zeroes) ? offset_end - position : sizeof(zeroes);
+        if (fwrite(zeroes, 1, n, file) != n) {
+            return false;
+        }
+
+        position += n;
+    }
+
+    return true;
+}
+
+/*
+Write the snapshot to "path" and free the writer.
+RETURN VALUE:
+    On success, true is returned.
+    On failure, false is returned.
+*/
+bool
+snapshot_writer_finish(SnapshotWriter *writer, const char *path) {
+    SnapshotHeader *header = &writer->header;
+
+    header->ctrl_offset = align_up(sizeof(SnapshotHeader), SNAPSHOT_CTRL_ALIGNMENT);
+    header->slots_offset = align_up(header->ctrl_offset + header->capacity, SNAPSHOT_CTRL_ALIGNMENT);
+    header->keys_offset = header->slots_offset + header->capacity * sizeof(SnapshotSlot);
+    header->values_offset = align_up(header->keys_offset + writer->keys_size, sizeof(uint64_t));
+    header->file_size = header->values_offset + writer->values_size;
+
+    for (size_t i = 0; i < header->capacity; i++) {
+        if (writer->ctrl[i] < 0) {
+            continue;
+        }
+
+        SnapshotSlot *slot = &writer->slots[i];
+
+        if (slot->keylen > SNAPSHOT_INLINE_KEY_MAX) {
+            slot->key.offset += header->keys_offset;
+        }
+
+        if (header->value_size > 0) {
+            slot->value += header->values_offset;
+        }
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        snapshot_writer_discard(writer);
+        return false;
+    }
+
+    bool ok = write_padded(file, header, sizeof(SnapshotHeader), header->ctrl_offset)
+           && write_padded(file, writer->ctrl, header->capacity, header->slots_offset)
+           && write_padded(file, writer->slots, header->capacity * sizeof(SnapshotSlot), header->keys_offset)
+           && write_padded(file, writer->keys, writer->keys_size, header->values_offset)
+           && write_padded(file, writer->values, writer->values_size, header->file_size);
+
+    ok = fclose(file) == 0 && ok;
+
+    snapshot_writer_discard(writer);
+
+    return ok;
+}
+
+void
+snapshot_writer_discard(SnapshotWriter *writer) {
+    free(writer->ctrl);
+    free(writer->slots);
+    free(writer->keys);
+    free(writer->values);
+
+    *writer = (SnapshotWriter) { 0 };
+}
+
+static bool
+header_valid(const SnapshotHeader *header, const size_t file_size) {
+    return memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0
+        && header->version == SNAPSHOT_VERSION
+        && header->byte_order_mark == SNAPSHOT_BYTE_ORDER_MARK
+        && header->group_width == BHM_CTRL_GROUP_WIDTH
+        && header->file_size == file_size
+        && header->capacity >= BHM_CTRL_GROUP_WIDTH
+        && (header->capacity & (header->capacity - 1)) == 0
+        && header->count < header->capacity
+        && header->ctrl_offset % SNAPSHOT_CTRL_ALIGNMENT == 0
+        && header->ctrl_offset + header->capacity <= header->slots_offset
+        && header->slots_offset + header->capacity * sizeof(SnapshotSlot) <= header->keys_offset
+        && header->keys_offset <= header->values_offset
+        && header->values_offset + header->count * header->value_size <= file_size;
+}
+
+/*
+Map the snapshot at "path" into memory read-only.
+RETURN VALUE:
+    On success, true is returned.
+    On failure (including a file that isn't a compatible snapshot), false is returned.
+*/
+bool
+snapshot_open(Snapshot *snapshot, const char *path) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    /* the mapping stays valid after the file is closed */
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    const SnapshotHeader *header = base;
+
+    if (!header_valid(header, st.st_size)) {
+        munmap(base, st.st_size);
+        return false;
+    }
+
+    *snapshot = (Snapshot) {
+        .base = base,
+        .size = st.st_size,
+        .header = header,
+        .ctrl = (const int8_t *) ((const unsigned char *) base + header->ctrl_offset),
+        .slots = (const SnapshotSlot *) ((const unsigned char *) base + header->slots_offset)
+    };
+
+    return true;
+}
+
+void
+snapshot_close(Snapshot *snapshot) {
+    munmap((void *) snapshot->base, snapshot->size);
+    *snapshot = (Snapshot) { 0 };
+}
+
+const unsigned char *
+snapshot_slot_key(const Snapshot *snapshot, const SnapshotSlot *slot) {
+    return slot->keylen <= SNAPSHOT_INLINE_KEY_MAX ? slot->key.bytes : snapshot->base + slot->key.offset;
+}
+
+void *
+snapshot_slot_value(const Snapshot *snapshot, const SnapshotSlot *slot) {
+    if (snapshot->header->value_size > 0) {
+        return (void *) (snapshot->base + slot->value);
+    }
+
+    return (void *) (uintptr_t) slot->value;
+}
+
+/*
+Return the index of the slot holding the key, or SIZE_MAX if the key isn't in the snapshot.
+*/
+size_t
+snapshot_find(const Snapshot *snapshot, const uint64_t hash, const void *key, const size_t keylen) {
+    const size_t group_mask = snapshot->header->capacity / BHM_CTRL_GROUP_WIDTH - 1;
+    const int8_t tag = BHM_CTRL_TAG(hash);
+
+    size_t group = (hash >> 7) & group_mask;
+
+    for (size_t step = 1; step <= group_mask + 1; step++) {
+        const size_t base = group * BHM_CTRL_GROUP_WIDTH;
+        const int8_t *ctrl = &snapshot->ctrl[base];
+
+        for (bhm_ctrl_mask match = bhm_ctrl_group_match(ctrl, tag); match; match &= match - 1) {
+            const SnapshotSlot *slot = &snapshot->slots[base + BHM_CTRL_MASK_FIRST(match)];
+
+            if (slot->hash == hash && slot->keylen == keylen && memcmp(key, snapshot_slot_key(snapshot, slot), keylen) == 0) {
+                return base + BHM_CTRL_MASK_FIRST(match);
+            }
+        }
+
+        if (bhm_ctrl_group_match_empty(ctrl)) {
+            return SIZE_MAX;
+        }
+
+        group = (group + step) & group_mask;
+    }
+
+    return SIZE_MAX;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+On-disk snapshot of a hash map, mapped back into memory read-only and queried in place.
+
+A snapshot is one file:
+
+    SnapshotHeader | control bytes | SnapshotSlot[capacity] | key bytes | value bytes
+
+The table is laid out like the open addressing backend: a power-of-two number of slots, each with
+a control byte holding a 7-bit tag of its hash, probed a group of control bytes at a time. Every
+location in the file is an offset from the start of the file, so the file can be mapped at any
+address and used without being deserialized or relocated.
+
+Keys of up to SNAPSHOT_INLINE_KEY_MAX bytes are stored in their slot; longer keys are stored in
+the key bytes. A value is either the value pointer of the map, stored as an integer (for values
+that are small integers or offsets rather than real pointers), or "value_size" bytes copied from
+what the value pointer points to, stored in the value bytes.
+
+Snapshots are only portable between machines of the same byte order and builds with the same
+control byte group width, both of which are recorded in the header and checked on opening. The
+file itself is trusted: only the header is validated.
+*/
+
+#define SNAPSHOT_MAGIC "BHMSNAP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_BYTE_ORDER_MARK 0x01020304u
+#define SNAPSHOT_INLINE_KEY_MAX 16
+
+typedef struct SnapshotHeader {
+    char magic[8];
+    uint32_t version,
+             byte_order_mark,
+             group_width,
+             builtin_hash;
+    uint64_t seed;
+    double max_load_factor;
+    uint64_t capacity,
+             count,
+             value_size;
+    uint64_t ctrl_offset,
+             slots_offset,
+             keys_offset,
+             values_offset,
+             file_size;
+} SnapshotHeader;
+
+typedef struct SnapshotSlot {
+    uint64_t hash,
+             keylen,
+             value;
+    union {
+        uint64_t offset;
+        unsigned char bytes[SNAPSHOT_INLINE_KEY_MAX];
+    } key;
+} SnapshotSlot;
+
+typedef struct Snapshot {
+    const unsigned char *base;
+    size_t size;
+
+    const SnapshotHeader *header;
+    const int8_t *ctrl;
+    const SnapshotSlot *slots;
+} Snapshot;
+
+/* builds a snapshot in memory, one entry at a time, then writes it out */
+typedef struct SnapshotWriter {
+    SnapshotHeader header;
+
+    int8_t *ctrl;
+    SnapshotSlot *slots;
+
+    unsigned char *keys,
+                  *values;
+    size_t keys_size,
+           keys_capacity,
+           values_size;
+} SnapshotWriter;
+
+bool
+snapshot_writer_init(SnapshotWriter *writer, const size_t count, const uint32_t builtin_hash, const uint64_t seed, const double max_load_factor, const size_t value_size);
+
+bool
+snapshot_writer_add(SnapshotWriter *writer, const uint64_t hash, const void *key, const size_t keylen, const void *value);
+
+bool
+snapshot_writer_finish(SnapshotWriter *writer, const char *path);
+
+void
+snapshot_writer_discard(SnapshotWriter *writer);
+
+bool
+snapshot_open(Snapshot *snapshot, const char *path);
+
+void
+snapshot_close(Snapshot *snapshot);
+
+size_t
+snapshot_find(const Snapshot *snapshot, const uint64_t hash, const void *key, const size_t keylen);
+
+const unsigned char *
+snapshot_slot_key(const Snapshot *snapshot, const SnapshotSlot *slot);
+
+void *
+snapshot_slot_value(const Snapshot *snapshot, const SnapshotSlot *slot);
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "bhashmap.h"
+
+/*
+Regression test: keys whose 32-bit hashes differ only in their high bits must still spread over
+the buckets of a BHM_INDEXING_POW2 map, with every backend. The hash function is the identity,
+and the keys are multiples of the capacity, so none of them differ in the bits a mask would keep.
+*/
+
+#define KEY_COUNT 2000
+#define CAPACITY 4096
+#define MAX_PROBE_LENGTH 8
+
+static uint32_t
+identity_hash(const void *data, size_t len) {
+    uint32_t key;
+    memcpy(&key, data, len < sizeof(key) ? len : sizeof(key));
+    return key;
+}
+
+static const char *BACKEND_NAMES[] = { "chaining", "open addressing", "dense" };
+
+int main(void) {
+    int failures = 0;
+
+    for (BHashMapBackend backend = BHM_BACKEND_CHAINING; backend <= BHM_BACKEND_DENSE; backend++) {
+        BHashMapConfig config = {
+            .hashfunc = identity_hash,
+            .indexing = BHM_INDEXING_POW2,
+            .backend = backend
+        };
+
+        BHashMap *map = bhm_create(CAPACITY, &config);
+        if (!map) {
+            fprintf(stderr, "%s: bhm_create failed\n", BACKEND_NAMES[backend]);
+            return EXIT_FAILURE;
+        }
+
+        for (uint32_t j = 0; j < KEY_COUNT; j++) {
+            const uint32_t key = j * CAPACITY;
+
+            if (!bhm_set_u32(map, key, (void *) (uintptr_t) (j + 1))) {
+                fprintf(stderr, "%s: bhm_set_u32 failed\n", BACKEND_NAMES[backend]);
+                return EXIT_FAILURE;
+            }
+        }
+
+        BHashMapStats stats;
+        bhm_get_stats(map, &stats);
+
+        printf("%-16s capacity %zu, max probe length %zu\n", BACKEND_NAMES[backend], stats.capacity, stats.max_probe_length);
+
+        if (stats.max_probe_length > MAX_PROBE_LENGTH) {
+            fprintf(stderr, "%s: max probe length %zu, expected at most %d\n", BACKEND_NAMES[backend], stats.max_probe_length, MAX_PROBE_LENGTH);
+            failures++;
+        }
+
+        if (backend == BHM_BACKEND_CHAINING && stats.chain_length_histogram[0] > stats.capacity - KEY_COUNT / 2) {
+            fprintf(stderr, "%s: %zu of %zu buckets are empty\n", BACKEND_NAMES[backend], stats.chain_length_histogram[0], stats.capacity);
+            failures++;
+        }
+
+        for (uint32_t j = 0; j < KEY_COUNT; j++) {
+            if (bhm_get_u32(map, j * CAPACITY) != (void *) (uintptr_t) (j + 1)) {
+                fprintf(stderr, "%s: key %u lost\n", BACKEND_NAMES[backend], j * CAPACITY);
+                failures++;
+                break;
+            }
+        }
+
+        bhm_destroy(map);
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+A 64-bit hash in the style of wyhash.
+
+Keys of up to 16 bytes are read with at most four overlapping loads and mixed with a single
+64x64->128-bit multiplication. Longer keys are consumed 16 (and, past 48 bytes, 48) bytes at a
+time by independent multiply-and-fold lanes, as in wyhash.
+
+Keys of WYHASH_STRIPE_THRESHOLD bytes and more first have all of their whole 64-byte stripes
+folded into eight 64-bit accumulators, in the style of XXH3: every 8-byte word is XORed with a
+per-lane secret, the two 32-bit halves of the result are multiplied together and added to its
+accumulator, and the word itself is added to the neighbouring accumulator. Each of these steps
+works on 32x32->64-bit products and 64-bit additions only, which AVX2 provides for four lanes at
+a time (SSE2 for two), so the stripes are hashed with AVX2 when the CPU supports it. The AVX2,
+SSE2 and scalar loops compute the exact same values, so the hash of a key depends neither on
+how the library was built nor on the CPU it runs on. The remaining bytes are then hashed as
+above.
+
+Keys are read as little-endian words.
+*/
+
+#define WYHASH_STRIPE_THRESHOLD 512
+#define WYHASH_STRIPE_LEN 64
+#define WYHASH_LANES 8
+/* the accumulators are scrambled every so many stripes, so that their high bits keep mixing in */
+#define WYHASH_SCRAMBLE_INTERVAL 16
+
+static const uint64_t WYHASH_P[4] = {
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+};
+
+static const uint64_t WYHASH_LANE_SECRET[WYHASH_LANES] = {
+    0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull,
+    0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull, 0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull
+};
+
+#define WYHASH_SCRAMBLE_PRIME 0x9e3779b1u
+
+static inline uint64_t
+wyhash_read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t
+wyhash_read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* 1 to 3 bytes, with the first, middle and last byte */
+static inline uint64_t
+wyhash_read_small(const unsigned char *p, const size_t len) {
+    return ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8) | p[len - 1];
+}
+
+/* multiply into a 128-bit product, leaving its low half in *a and its high half in *b */
+static inline void
+wyhash_mum(uint64_t *a, uint64_t *b) {
+    const __uint128_t r = (__uint128_t) *a * *b;
+    *a = (uint64_t) r;
+    *b = (uint64_t) (r >> 64);
+}
+
+static inline uint64_t
+wyhash_mix(uint64_t a, uint64_t b) {
+    wyhash_mum(&a, &b);
+    return a ^ b;
+}
+
+/*
+The stripe loop, in three equivalent implementations. Each folds "stripe_count" stripes starting
+at "p" into "acc".
+*/
+static inline void
+wyhash_accumulate_scalar(uint64_t *acc, const uint64_t *secret, const unsigned char *p, const size_t stripe_count) {
+    for (size_t s = 0; s < stripe_count; s++, p += WYHASH_STRIPE_LEN) {
+        for (unsigned j = 0; j < WYHASH_LANES; j++) {
+            const uint64_t data = wyhash_read64(p + j * 8),
+                           keyed = data ^ secret[j];
+
+            acc[j ^ 1] += data;
+            acc[j] += (keyed & 0xffffffffu) * (keyed >> 32);
+        }
+
+        if ((s + 1) % WYHASH_SCRAMBLE_INTERVAL == 0) {
+            for (unsigned j = 0; j < WYHASH_LANES; j++) {
+                acc[j] = (acc[j] ^ (acc[j] >> 47) ^ secret[j]) * WYHASH_SCRAMBLE_PRIME;
+            }
+        }
+    }
+}
+
+#if defined(__SSE2__)
+static inline void
+wyhash_accumulate_sse2(uint64_t *acc, const uint64_t *secret, const unsigned char *p, const size_t stripe_count) {
+    __m128i acc_v[WYHASH_LANES / 2],
+            secret_v[WYHASH_LANES / 2];
+
+    for (unsigned v = 0; v < WYHASH_LANES / 2; v++) {
+        acc_v[v] = _mm_loadu_si128((const __m128i *) &acc[v * 2]);
+        secret_v[v] = _mm_loadu_si128((const __m128i *) &secret[v * 2]);
+    }
+
+    const __m128i prime = _mm_set1_epi32((int) WYHASH_SCRAMBLE_PRIME);
+
+    for (size_t s = 0; s < stripe_count; s++, p += WYHASH_STRIPE_LEN) {
+        for (unsigned v = 0; v < WYHASH_LANES / 2; v++) {
+            const __m128i data = _mm_loadu_si128((const __m128i *) (p + v * 16)),
+                          keyed = _mm_xor_si128(data, secret_v[v]),
+                          /* low half times high half of each 64-bit lane */
+                          product = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1))),
+                          /* the words trade places, each is added to the other lane's accumulator */
+                          swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+
+            acc_v[v] = _mm_add_epi64(acc_v[v], _mm_add_epi64(product, swapped));
+        }
+
+        if ((s + 1) % WYHASH_SCRAMBLE_INTERVAL == 0) {
+            for (unsigned v = 0; v < WYHASH_LANES / 2; v++) {
+                __m128i a = _mm_xor_si128(acc_v[v], _mm_srli_epi64(acc_v[v], 47));
+                a = _mm_xor_si128(a, secret_v[v]);
+
+                /* 64-bit times 32-bit multiplication out of two 32x32->64-bit ones */
+                const __m128i lo = _mm_mul_epu32(a, prime),
+                              hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+
+                acc_v[v] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+            }
+        }
+    }
+
+    for (unsigned v = 0; v < WYHASH_LANES / 2; v++) {
+        _mm_storeu_si128((__m128i *) &acc[v * 2], acc_v[v]);
+    }
+}
+#endif
+
+/*
+With GCC and Clang on x86-64, the AVX2 loop is compiled even when the rest of the library isn't
+built for AVX2, and is picked at runtime if the CPU supports it.
+*/
+#if defined(__AVX2__) || (defined(__x86_64__) && defined(__GNUC__))
+#define WYHASH_HAVE_AVX2
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+static inline void
+wyhash_accumulate_avx2(uint64_t *acc, const uint64_t *secret, const unsigned char *p, const size_t stripe_count) {
+    __m256i acc_v[WYHASH_LANES / 4],
+            secret_v[WYHASH_LANES / 4];
+
+    for (unsigned v = 0; v < WYHASH_LANES / 4; v++) {
+        acc_v[v] = _mm256_loadu_si256((const __m256i *) &acc[v * 4]);
+        secret_v[v] = _mm256_loadu_si256((const __m256i *) &secret[v * 4]);
+    }
+
+    const __m256i prime = _mm256_set1_epi32((int) WYHASH_SCRAMBLE_PRIME);
+
+    for (size_t s = 0; s < stripe_count; s++, p += WYHASH_STRIPE_LEN) {
+        for (unsigned v = 0; v < WYHASH_LANES / 4; v++) {
+            const __m256i data = _mm256_loadu_si256((const __m256i *) (p + v * 32)),
+                          keyed = _mm256_xor_si256(data, secret_v[v]),
+                          product = _mm256_mul_epu32(keyed, _mm256_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1))),
+                          swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+
+            acc_v[v] = _mm256_add_epi64(acc_v[v], _mm256_add_epi64(product, swapped));
+        }
+
+        if ((s + 1) % WYHASH_SCRAMBLE_INTERVAL == 0) {
+            for (unsigned v = 0; v < WYHASH_LANES / 4; v++) {
+                __m256i a = _mm256_xor_si256(acc_v[v], _mm256_srli_epi64(acc_v[v], 47));
+                a = _mm256_xor_si256(a, secret_v[v]);
+
+                const __m256i lo = _mm256_mul_epu32(a, prime),
+                              hi = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), prime);
+
+                acc_v[v] = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+            }
+        }
+    }
+
+    for (unsigned v = 0; v < WYHASH_LANES / 4; v++) {
+        _mm256_storeu_si256((__m256i *) &acc[v * 4], acc_v[v]);
+    }
+}
+#endif
+
+/*
+Fold "stripe_count" 64-byte stripes into accumulators and reduce them to a new seed.
+*/
+static inline uint64_t
+wyhash_stripes(const unsigned char *p, const size_t stripe_count, const uint64_t seed) {
+    uint64_t secret[WYHASH_LANES],
+             acc[WYHASH_LANES];
+
+    for (unsigned j = 0; j < WYHASH_LANES; j++) {
+        secret[j] = WYHASH_LANE_SECRET[j] ^ seed;
+        acc[j] = WYHASH_P[j % 4];
+    }
+
+    #if defined(__AVX2__)
+    wyhash_accumulate_avx2(acc, secret, p, stripe_count);
+    #else
+    #if defined(WYHASH_HAVE_AVX2)
+    if (__builtin_cpu_supports("avx2")) {
+        wyhash_accumulate_avx2(acc, secret, p, stripe_count);
+    } else
+    #endif
+    {
+        #if defined(__SSE2__)
+        wyhash_accumulate_sse2(acc, secret, p, stripe_count);
+        #else
+        wyhash_accumulate_scalar(acc, secret, p, stripe_count);
+        #endif
+    }
+    #endif
+
+    uint64_t result = seed ^ (stripe_count * WYHASH_P[0]);
+
+    for (unsigned j = 0; j < WYHASH_LANES; j += 2) {
+        result ^= wyhash_mix(acc[j] ^ secret[j], acc[j + 1] ^ WYHASH_P[(j / 2) % 4]);
+    }
+
+    return result;
+}
+
+static inline uint64_t
+wyhash64(const void *data, const size_t len, uint64_t seed) {
+    const unsigned char *p = data;
+    uint64_t a, b;
+
+    seed ^= wyhash_mix(seed ^ WYHASH_P[0], WYHASH_P[1]);
+
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (wyhash_read32(p) << 32) | wyhash_read32(p + ((len >> 3) << 2));
+            b = (wyhash_read32(p + len - 4) << 32) | wyhash_read32(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = wyhash_read_small(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+
+        if (i >= WYHASH_STRIPE_THRESHOLD) {
+            const size_t stripe_count = i / WYHASH_STRIPE_LEN;
+
+            seed = wyhash_stripes(p, stripe_count, seed);
+            p += stripe_count * WYHASH_STRIPE_LEN;
+            i -= stripe_count * WYHASH_STRIPE_LEN;
+        }
+
+        if (i > 48) {
+            uint64_t see1 = seed,
+                     see2 = seed;
+
+            do {
+                seed = wyhash_mix(wyhash_read64(p) ^ WYHASH_P[1], wyhash_read64(p + 8) ^ seed);
+                see1 = wyhash_mix(wyhash_read64(p + 16) ^ WYHASH_P[2], wyhash_read64(p + 24) ^ see1);
+                see2 = wyhash_mix(wyhash_read64(p + 32) ^ WYHASH_P[3], wyhash_read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+
+            seed ^= see1 ^ see2;
+        }
+
+        while (i > 16) {
+            seed = wyhash_mix(wyhash_read64(p) ^ WYHASH_P[1], wyhash_read64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+
+        /* the key is longer than 16 bytes, so the last 16 bytes can always be read, overlapping or not */
+        a = wyhash_read64(p + i - 16);
+        b = wyhash_read64(p + i - 8);
+    }
+
+    a ^= WYHASH_P[1];
+    b ^= seed;
+    wyhash_mum(&a, &b);
+
+    return wyhash_mix(a ^ WYHASH_P[0] ^ len, b ^ WYHASH_P[1]);
+}